@@ -0,0 +1,420 @@
+// kernelbench: the hot kernels of the simulation in isolation
+//
+// kernelbench [config=../settings/config.ini] [kernels=all] [N=10000] [dim=0]
+//             [density=0] [ann=<agents.ann>] [L=<agents.L>] [threads=<omp_threads>]
+//             [samples=15] [min_time=0.02] [warmup=10] [--csv] [<parameter>=<value> ...]
+//
+// N, dim, ann, L and threads take comma separated lists, ann=all and L=all
+// run every Ann type and L of make_any_ann. The kernels run on the state
+// of a simulation after warmup timesteps, on a synthetic landscape of
+// dim x dim cells (power of two, 0: the capacity image). density > 0
+// sets N = density * dim * dim. Any other argument is a simulation parameter.
+// Run from bin/, like cinema.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <omp.h>
+#include <cine/simulation.h>
+#include <cine/cmd_line.h>
+#include <cine/archive.hpp>
+
+
+namespace cine2 {
+
+
+  // Drives single steps of Simulation::simulate_timestep, friend of Simulation
+  class KernelBench
+  {
+  public:
+    KernelBench(const Param& param, int dim, int warmup) : sim_(param)
+    {
+      if (dim > 0 && dim != sim_.landscape_.dim()) {
+        synthetic_landscape(dim);
+      }
+      for (int t = 0; t < warmup; ++t) {
+        sim_.simulate_timestep(0, t_++);
+      }
+      snapshot();
+    }
+
+    int N() const { return sim_.agents_.pop.size(); }
+    int cells() const { return sim_.landscape_.dim() * sim_.landscape_.dim(); }
+    size_t ann_bytes() const { return size_t(N()) * sim_.agents_.ann->type_size(); }
+
+    void move()
+    {
+      sim_.agents_.ann->move(sim_.landscape_, sim_.agents_.pop, sim_.param_.agents, streams());
+    }
+
+    void occupancy()
+    {
+      using Layers = Landscape::Layers;
+      sim_.landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, sim_.agents_.pop, sim_.param_.landscape.foragers_kernel);
+    }
+
+    void attacks()
+    {
+      sim_.resolve_grazing_and_attacks(streams());
+    }
+
+    void growth()
+    {
+      sim_.grow_items(streams());
+    }
+
+    // restores the post-warm-up agents, move changes them
+    void restore_agents()
+    {
+      auto& pop = sim_.agents_.pop;
+      std::memcpy(pop.data(), pop0_.data(), pop.mem_size());
+    }
+
+    // restores the post-warm-up agents, items, intake and cell index,
+    // resolve_grazing_and_attacks changes them
+    void restore_attacks()
+    {
+      using Layers = Landscape::Layers;
+      auto& landscape = sim_.landscape_;
+      restore_agents();
+      std::memcpy(landscape.items_layer().data(), items0_.data(), items0_.size() * sizeof(Landscape::item_t));
+      std::memcpy(landscape[Layers::foragers_intake].data(), foragers_intake0_.data(), foragers_intake0_.size() * sizeof(float));
+      std::memcpy(landscape[Layers::klepts_intake].data(), klepts_intake0_.data(), klepts_intake0_.size() * sizeof(float));
+      landscape.update_agent_index(sim_.agents_.pop);
+      sim_.agents_.conflicts = conflicts0_;
+    }
+
+    void analysis()
+    {
+      sim_.analysis_.generation(&sim_);
+    }
+
+    // drops the rows appended by analysis(), every call starts on an empty history
+    void clear_analysis()
+    {
+      std::vector<Analysis::Summary> summary;
+      std::array<std::vector<Analysis::Input>, 3> input;
+      summary.reserve(1);
+      for (auto& in : input) in.reserve(1);
+      sim_.analysis_.restore(std::move(summary), std::move(input));
+    }
+
+    size_t compress()
+    {
+      const auto& ann = *sim_.agents_.ann;
+      auto cp = sim_.param_.archive.codec;
+      cp.typesize = 4;
+      return archive::compress(ann.data(), ann.N(), ann.state_size() * sizeof(float), ann.stride() * sizeof(float), cp).csize;
+    }
+
+    void mutate()
+    {
+      sim_.agents_.ann->mutate(sim_.param_.agents, false, streams());
+    }
+
+    // create_new_generation requires the fitness of the current one
+    void assess_fitness()
+    {
+      sim_.assess_fitness();
+    }
+
+    void new_generation()
+    {
+      sim_.create_new_generations(t_++);
+    }
+
+  private:
+    // post-warm-up state of the kernels that change it
+    void snapshot()
+    {
+      using Layers = Landscape::Layers;
+      const auto& landscape = sim_.landscape_;
+      const size_t cells = size_t(landscape.dim()) * landscape.dim();
+      pop0_ = sim_.agents_.pop;
+      const auto* items = landscape.items_layer().data();
+      items0_.assign(items, items + cells);
+      const float* foragers_intake = landscape[Layers::foragers_intake].data();
+      foragers_intake0_.assign(foragers_intake, foragers_intake + cells);
+      const float* klepts_intake = landscape[Layers::klepts_intake].data();
+      klepts_intake0_.assign(klepts_intake, klepts_intake + cells);
+      conflicts0_ = sim_.agents_.conflicts;
+    }
+
+    // fresh streams for every call
+    rnd::streams streams() { return sim_.streams(0, t_++); }
+
+    // uniform random capacity, full items, agents scattered at random
+    void synthetic_landscape(int dim)
+    {
+      using Layers = Landscape::Layers;
+      const auto& lparam = sim_.param_.landscape;
+      const auto rs = sim_.streams(-1, 0);
+      Landscape landscape(dim, lparam.layout);
+      landscape.occupancy(lparam.occupancy);
+      float* capacity = landscape[Layers::capacity].data();
+      Landscape::item_t* items = landscape.items_layer().data();
+      for (int y = 0; y < dim; ++y) {
+        auto reng = rs(rnd::purpose::item_growth, y);
+        std::uniform_real_distribution<float> udist(0.f, 1.f);
+        for (int x = 0; x < dim; ++x) {
+          const int i = landscape.index(x, y);
+          capacity[i] = udist(reng);
+          items[i] = static_cast<Landscape::item_t>(std::floor(capacity[i] * lparam.max_item_cap));
+        }
+      }
+      sim_.landscape_ = std::move(landscape);
+      if (lparam.regrowth == Regrowth::wheel) {
+        sim_.regrowth_.init(sim_.landscape_, lparam.item_growth, rs);
+      }
+      auto coorDist = std::uniform_int_distribution<short>(0, short(dim - 1));
+      auto reng = rs(rnd::purpose::init_position, 0);
+      for (int i = 0; i < N(); ++i) {
+        auto& pos = sim_.agents_.pop.pos()[i];
+        pos.x = coorDist(reng);
+        pos.y = coorDist(reng);
+      }
+      occupancy();
+    }
+
+    Simulation sim_;
+    int t_ = 0;
+    Individuals pop0_;
+    std::vector<Landscape::item_t> items0_;
+    std::vector<float> foragers_intake0_, klepts_intake0_;
+    int conflicts0_ = 0;
+  };
+
+}
+
+
+using namespace cine2;
+
+
+struct options
+{
+  std::vector<std::string> kernels;
+  std::vector<int> N, dim, L, threads;
+  std::vector<std::string> ann;
+  double density;
+  int samples;
+  double min_time;      // [s] per sample
+  int warmup;
+  bool csv;
+};
+
+
+struct result
+{
+  std::string kernel, ann;
+  int L, N, dim, threads;
+  double median = 0, q1 = 0, q3 = 0, mini = 0;    // [s] per call
+  double agents = 0, cells = 0, bytes = 0;        // per call, 0: n/a
+};
+
+
+const char* all_kernels = "move,occupancy,attacks,growth,analysis,compress,mutate,new_generation";
+
+
+std::vector<std::string> split(const std::string& str, char delim)
+{
+  std::vector<std::string> res;
+  std::istringstream is(str);
+  std::string item;
+  while (std::getline(is, item, delim)) {
+    if (!item.empty()) res.push_back(item);
+  }
+  return res;
+}
+
+
+std::vector<int> int_list(const std::string& name, const std::string& str)
+{
+  std::vector<int> res;
+  for (const auto& item : split(str, ',')) {
+    try {
+      res.push_back(std::stoi(item));
+    }
+    catch (std::logic_error&) {
+      throw cmd::parse_error(name + ": invalid value '" + item + "'");
+    }
+  }
+  if (res.empty()) throw cmd::parse_error(name + ": empty list");
+  return res;
+}
+
+
+// times fun, median and quartiles of samples of >= min_time each
+template <typename Fun, typename Setup>
+void measure(const options& opt, result& res, Fun&& fun, Setup&& setup)
+{
+  using clock = std::chrono::steady_clock;
+  auto timed = [&](int calls) {
+    double sum = 0;
+    for (int i = 0; i < calls; ++i) {
+      setup();
+      const auto t0 = clock::now();
+      fun();
+      sum += std::chrono::duration<double>(clock::now() - t0).count();
+    }
+    return sum;
+  };
+  // warm up, calls per sample
+  int calls = 1;
+  for (double t = timed(1); t < opt.min_time && calls < (1 << 20); t = timed(calls)) {
+    calls = (t > 0) ? std::max(2 * calls, static_cast<int>(calls * 1.2 * opt.min_time / t)) : 2 * calls;
+  }
+  std::vector<double> s;
+  for (int i = 0; i < opt.samples; ++i) {
+    s.push_back(timed(calls) / calls);
+  }
+  std::sort(s.begin(), s.end());
+  const auto quantile = [&](double q) { return s[static_cast<size_t>(q * (s.size() - 1) + 0.5)]; };
+  res.median = quantile(0.5);
+  res.q1 = quantile(0.25);
+  res.q3 = quantile(0.75);
+  res.mini = s.front();
+}
+
+
+template <typename Fun>
+void measure(const options& opt, result& res, Fun&& fun)
+{
+  measure(opt, res, std::forward<Fun>(fun), [] {});
+}
+
+
+// the parameters of config with args and the benchmark point on top,
+// sets the number of OpenMP threads
+Param make_param(const std::vector<std::string>& args, const std::string& config, int N, const std::string& ann, int L, int threads)
+{
+  std::vector<std::string> argv{ "kernelbench",
+    "agents.N=" + std::to_string(N),
+    "agents.ann=" + ann,
+    "agents.L=" + std::to_string(L),
+    "omp_threads=" + std::to_string(threads),
+  };
+  argv.insert(argv.end(), args.cbegin(), args.cend());
+  argv.push_back("seed=1");
+  cmd::cmd_line_parser clp(argv);
+  clp.append(config_file_parser(config));
+  Param param = parse_parameter(clp);
+  const auto unknown = clp.unrecognized();
+  if (!unknown.empty()) throw cmd::parse_error("unknown argument '" + unknown.front() + "'");
+  param.outdir.clear();
+  return param;
+}
+
+
+void print(const options& opt, const result& r, bool header)
+{
+  if (opt.csv) {
+    if (header) std::cout << "kernel,ann,L,N,dim,threads,median_s,q1_s,q3_s,min_s,ns_agent,ns_cell,MB_s\n";
+    std::cout << r.kernel << ',' << r.ann << ',' << r.L << ',' << r.N << ',' << r.dim << ',' << r.threads << ','
+              << r.median << ',' << r.q1 << ',' << r.q3 << ',' << r.mini << ','
+              << (r.agents ? 1e9 * r.median / r.agents : 0) << ','
+              << (r.cells ? 1e9 * r.median / r.cells : 0) << ','
+              << (r.bytes ? 1e-6 * r.bytes / r.median : 0) << '\n';
+    return;
+  }
+  if (header) {
+    std::cout << std::left << std::setw(16) << "kernel" << std::setw(13) << "ann" << std::right
+              << std::setw(4) << "L" << std::setw(9) << "N" << std::setw(6) << "dim" << std::setw(4) << "thr"
+              << std::setw(12) << "us/call" << std::setw(8) << "iqr%"
+              << std::setw(11) << "ns/agent" << std::setw(10) << "ns/cell" << std::setw(10) << "MB/s" << '\n';
+  }
+  auto per = [](double t, double n) {
+    std::ostringstream os;
+    if (n) os << std::fixed << std::setprecision(2) << 1e9 * t / n; else os << '-';
+    return os.str();
+  };
+  std::ostringstream mbs;
+  if (r.bytes) mbs << std::fixed << std::setprecision(0) << 1e-6 * r.bytes / r.median; else mbs << '-';
+  std::cout << std::left << std::setw(16) << r.kernel << std::setw(13) << r.ann << std::right
+            << std::setw(4) << r.L << std::setw(9) << r.N << std::setw(6) << r.dim << std::setw(4) << r.threads
+            << std::setw(12) << std::fixed << std::setprecision(1) << 1e6 * r.median
+            << std::setw(8) << std::setprecision(1) << 100.0 * (r.q3 - r.q1) / r.median
+            << std::setw(11) << per(r.median, r.agents) << std::setw(10) << per(r.median, r.cells)
+            << std::setw(10) << mbs.str() << std::endl;
+}
+
+
+int main(int argc, const char** argv)
+{
+  try {
+    cmd::cmd_line_parser clp(argc, argv);
+    const auto config = clp.optional_val("config", std::string("../settings/config.ini"));
+    const auto cfg = config_file_parser(config);
+    options opt;
+    auto kernels = clp.optional_val("kernels", std::string("all"));
+    opt.kernels = split(kernels == "all" ? all_kernels : kernels, ',');
+    const auto known = split(all_kernels, ',');
+    for (const auto& k : opt.kernels) {
+      if (std::find(known.cbegin(), known.cend(), k) == known.cend()) throw cmd::parse_error("kernels: unknown kernel '" + k + "'");
+    }
+    // defaults from the simulation parameters
+    const auto N = clp.optional_val("agents.N", cfg.optional_val("agents.N", 10000));
+    const auto ann = clp.optional_val("agents.ann", cfg.optional_val("agents.ann", std::string("SmartAnn")));
+    const auto L = clp.optional_val("agents.L", cfg.optional_val("agents.L", 5));
+    const auto threads = clp.optional_val("omp_threads", omp_get_max_threads());
+    opt.N = int_list("N", clp.optional_val("N", std::to_string(N)));
+    opt.dim = int_list("dim", clp.optional_val("dim", std::string("0")));
+    opt.density = clp.optional_val("density", 0.0);
+    const auto anns = clp.optional_val("ann", ann);
+    opt.ann = split(anns == "all" ? "DumbAnn,SimpleAnn,SimpleAnnFB,SmartAnn" : anns, ',');
+    const auto Ls = clp.optional_val("L", std::to_string(L));
+    opt.L = int_list("L", Ls == "all" ? "3,5,7,33" : Ls);
+    opt.threads = int_list("threads", clp.optional_val("threads", std::to_string(threads)));
+    opt.samples = std::max(1, clp.optional_val("samples", 15));
+    opt.min_time = clp.optional_val("min_time", 0.02);
+    opt.warmup = clp.optional_val("warmup", 10);
+    opt.csv = clp.flag("--csv");
+    const auto sim_args = clp.unrecognized();   // simulation parameters
+
+    bool header = true;
+    for (int threads : opt.threads) {
+      for (int dim : opt.dim) {
+        for (int N0 : opt.N) {
+          const int N = (opt.density > 0 && dim > 0) ? std::max(1, static_cast<int>(opt.density * dim * dim)) : N0;
+          // move for every Ann type and L, the other kernels on the first one
+          for (size_t a = 0; a < opt.ann.size(); ++a) {
+            for (size_t l = 0; l < opt.L.size(); ++l) {
+              const bool first = (a == 0 && l == 0);
+              const Param param = make_param(sim_args, config, N, opt.ann[a], opt.L[l], threads);
+              KernelBench kb(param, dim, opt.warmup);
+              for (const auto& k : opt.kernels) {
+                if (!first && k != "move") continue;
+                result r{ k, opt.ann[a], opt.L[l], kb.N(), static_cast<int>(std::lround(std::sqrt(kb.cells()))), threads };
+                if (k == "move") { measure(opt, r, [&] { kb.move(); }, [&] { kb.restore_agents(); }); r.agents = kb.N(); r.bytes = double(kb.ann_bytes()); }
+                else if (k == "occupancy") { measure(opt, r, [&] { kb.occupancy(); }); r.agents = kb.N(); r.cells = kb.cells(); }
+                else if (k == "attacks") { measure(opt, r, [&] { kb.attacks(); }, [&] { kb.restore_attacks(); }); r.agents = kb.N(); }
+                else if (k == "growth") { measure(opt, r, [&] { kb.growth(); }); r.cells = kb.cells(); }
+                else if (k == "analysis") { measure(opt, r, [&] { kb.analysis(); }, [&] { kb.clear_analysis(); }); r.agents = kb.N(); r.cells = kb.cells(); }
+                else if (k == "compress") { measure(opt, r, [&] { kb.compress(); }); r.bytes = double(kb.ann_bytes()); }
+                else if (k == "mutate") { measure(opt, r, [&] { kb.mutate(); }); r.agents = kb.N(); r.bytes = double(kb.ann_bytes()); }
+                else if (k == "new_generation") { measure(opt, r, [&] { kb.new_generation(); }, [&] { kb.assess_fitness(); }); r.agents = kb.N(); r.bytes = double(kb.ann_bytes()); }
+                print(opt, r, header);
+                header = false;
+              }
+            }
+          }
+        }
+      }
+    }
+    return 0;
+  }
+  catch (cmd::parse_error& err) {
+    std::cerr << "\nParameter trouble: " << err.what() << '\n';
+  }
+  catch (std::exception& err) {
+    std::cerr << "\nExeption caught: " << err.what() << '\n';
+  }
+  catch (...) {
+    std::cerr << "\nUnknown exeption caught\n";
+  }
+  return 1;
+}
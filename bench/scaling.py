@@ -0,0 +1,249 @@
+"""scaling.py -- strong/weak scaling of Simulation::run
+
+    cd build/bin
+    python3 ../../bench/scaling.py threads=1,2,4,8 N=10000,100000 dim=256,1024 [out=scaling] [--weak]
+
+Runs cinema for every (threads, N, dim) of the grid, for G generations
+of T timesteps without observers, and times it with the phase profiler
+(profile.summary). dim=0 keeps the capacity image of the config, other
+dims replace it by a random capacity image of that size, written to
+../settings/scaling/. With --weak, N is the population per thread:
+the runs use N * threads agents.
+
+Output in out/:
+    scaling.json   grid, runs and curves (machine readable)
+    scaling.csv    one line per run and phase
+    run_*.ini      generated configs, run_*.tsv profiler tables
+
+Per run: seconds per generation, agent-steps per second
+(N * T / seconds) and the per-phase breakdown in ms per generation.
+Per curve (fixed N, dim; weak: fixed N per thread, dim), relative to
+the smallest thread count p0 with time t0:
+    strong: speedup = t0 / tp, efficiency = speedup * p0 / p
+    weak:   speedup = (t0 / tp) * p / p0, efficiency = t0 / tp
+Other key=value arguments are passed to cinema, e.g. agents.ann=SmartAnn.
+"""
+
+import csv
+import json
+import os
+import random
+import struct
+import subprocess
+import sys
+import zlib
+
+
+# top level phases, they add up to the generation (see profiler.h)
+TOP_PHASES = ["timestep", "fitness", "analysis", "observer", "new_generation", "checkpoint"]
+
+DEFAULTS = {
+    "config": "../settings/config.ini",
+    "cinema": "./cinema",
+    "settings": "../settings",
+    "out": "scaling",
+    "threads": "1",
+    "N": "10000",
+    "dim": "0",
+    "G": "3",
+    "T": "100",
+    "skip": "1",            # leading generations excluded from timing
+    "seed": "1",
+}
+
+
+def parse_args(argv):
+    opt = dict(DEFAULTS)
+    opt["weak"] = False
+    sim = []
+    for arg in argv:
+        if arg == "--weak":
+            opt["weak"] = True
+        elif arg in ("-h", "--help"):
+            print(__doc__)
+            sys.exit(0)
+        elif "=" in arg and arg.split("=", 1)[0] in DEFAULTS:
+            key, val = arg.split("=", 1)
+            opt[key] = val
+        elif "=" in arg:
+            sim.append(arg)
+        else:
+            raise ValueError("unknown argument " + arg)
+    grid = {}
+    for key in ("threads", "N", "dim"):
+        grid[key] = [int(x) for x in opt[key].split(",")]
+    for key in ("G", "T", "skip"):
+        opt[key] = int(opt[key])
+    if min(grid["threads"]) < 1 or min(grid["N"]) < 1:
+        raise ValueError("threads and N shall be > 0")
+    for dim in grid["dim"]:
+        if dim < 0 or dim & (dim - 1):
+            raise ValueError("dim shall be 0 or a power of two")
+    if not 0 <= opt["skip"] < opt["G"]:
+        raise ValueError("skip shall be in [0, G)")
+    return opt, grid, sim
+
+
+def write_png(file, dim, seed):
+    """8 bit RGB png, random red channel"""
+    rng = random.Random(seed)
+    raw = bytearray()
+    for _ in range(dim):
+        raw.append(0)     # filter: none
+        for _ in range(dim):
+            raw += bytes((rng.randrange(256), 0, 0))
+
+    def chunk(tag, data):
+        return struct.pack(">I", len(data)) + tag + data + struct.pack(">I", zlib.crc32(tag + data))
+
+    with open(file, "wb") as os_:
+        os_.write(b"\x89PNG\r\n\x1a\n")
+        os_.write(chunk(b"IHDR", struct.pack(">IIBBBBB", dim, dim, 8, 2, 0, 0, 0)))
+        os_.write(chunk(b"IDAT", zlib.compress(bytes(raw), 6)))
+        os_.write(chunk(b"IEND", b""))
+
+
+def capacity_image(opt, dim):
+    """name of the capacity image relative to settings, None: config"""
+    if dim == 0:
+        return None
+    name = "scaling/capacity_%d.png" % dim
+    file = os.path.join(opt["settings"], name)
+    if not os.path.exists(file):
+        os.makedirs(os.path.dirname(file), exist_ok=True)
+        write_png(file, dim, dim)
+    return name
+
+
+def write_config(opt, sim, run, base):
+    # first match wins, overrides go in front of the config
+    lines = ["omp_threads=%d" % run["threads"],
+             "agents.N=%d" % run["N"],
+             "G=%d" % opt["G"],
+             "T=%d" % opt["T"],
+             "Gburnin=0",
+             "seed=" + opt["seed"],
+             "replay.every=0",
+             "checkpoint.every=0",
+             "profile.summary=" + os.path.abspath(run["summary"]),
+             "profile.every=1"]
+    if run["image"]:
+        lines += ["landscape.capacity.image=" + run["image"], "landscape.capacity.channel=0"]
+    lines += sim
+    with open(run["config"], "w") as os_:
+        os_.write("# generated by scaling.py\n" + "\n".join(lines) + "\n\n" + base)
+
+
+def read_summary(file, skip):
+    """phase -> [calls, ms, max_thread_ms] summed over generations >= skip, generations"""
+    phases, gens = {}, set()
+    with open(file) as is_:
+        for row in csv.DictReader(is_, delimiter="\t"):
+            g = int(row["g"])
+            if g < skip:
+                continue
+            gens.add(g)
+            acc = phases.setdefault(row["phase"], [0, 0.0, 0.0])
+            acc[0] += int(row["calls"])
+            acc[1] += float(row["ms"])
+            acc[2] += float(row["max_thread_ms"])
+    return phases, len(gens)
+
+
+def run_one(opt, sim, base, threads, N, dim):
+    tag = "run_p%d_N%d_dim%d" % (threads, N, dim)
+    run = {"threads": threads, "N": N, "dim": dim,
+           "image": capacity_image(opt, dim),
+           "config": os.path.join(opt["out"], tag + ".ini"),
+           "summary": os.path.join(opt["out"], tag + ".tsv")}
+    write_config(opt, sim, run, base)
+    print("%-28s" % tag, end=" ", flush=True)
+    res = subprocess.run([opt["cinema"], "config=" + os.path.abspath(run["config"]), "--quiet"],
+                         stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if res.returncode != 0:
+        raise RuntimeError("%s failed:\n%s" % (tag, res.stdout))
+    phases, gens = read_summary(run["summary"], opt["skip"])
+    if gens == 0:
+        raise RuntimeError(tag + ": no timed generation")
+    seconds = 1e-3 * sum(phases[p][1] for p in TOP_PHASES if p in phases) / gens
+    run.update({
+        "generations": gens,
+        "seconds": seconds,
+        "agent_steps_per_s": N * opt["T"] / seconds,
+        "phases": {p: {"calls": c / gens, "ms": ms / gens, "max_thread_ms": mt / gens}
+                   for p, (c, ms, mt) in phases.items()},
+    })
+    del run["image"]
+    print("%9.3f s/gen %12.4g agent-steps/s" % (seconds, run["agent_steps_per_s"]))
+    return run
+
+
+def curve(runs, mode):
+    """scaling curve of runs (ascending threads)"""
+    p0, t0 = runs[0]["threads"], runs[0]["seconds"]
+    points = []
+    for r in runs:
+        p, tp = r["threads"], r["seconds"]
+        if mode == "strong":
+            speedup = t0 / tp
+            eff = speedup * p0 / p
+        else:
+            eff = t0 / tp
+            speedup = eff * p / p0
+        phase_eff = {}
+        for name, ph in r["phases"].items():
+            ref = runs[0]["phases"].get(name)
+            if ref and ph["ms"] > 0:
+                e = ref["ms"] / ph["ms"]
+                phase_eff[name] = e * p0 / p if mode == "strong" else e
+        points.append({"threads": p, "N": r["N"], "seconds": tp,
+                       "agent_steps_per_s": r["agent_steps_per_s"],
+                       "speedup": speedup, "efficiency": eff,
+                       "phase_efficiency": phase_eff})
+    return points
+
+
+def main(argv):
+    opt, grid, sim = parse_args(argv)
+    with open(opt["config"]) as is_:
+        base = is_.read()
+    os.makedirs(opt["out"], exist_ok=True)
+    mode = "weak" if opt["weak"] else "strong"
+    runs, curves, rows = [], [], []
+    for dim in grid["dim"]:
+        for N in grid["N"]:
+            cur = [run_one(opt, sim, base, p, N * p if opt["weak"] else N, dim) for p in sorted(grid["threads"])]
+            points = curve(cur, mode)
+            runs += cur
+            curves.append({"mode": mode, "dim": dim, "N": N, "points": points})
+            rows += zip(cur, points)
+
+    report = {"mode": mode, "grid": grid, "G": opt["G"], "T": opt["T"], "skip": opt["skip"],
+              "config": opt["config"], "args": sim, "runs": runs, "curves": curves}
+    with open(os.path.join(opt["out"], "scaling.json"), "w") as os_:
+        json.dump(report, os_, indent=1)
+    with open(os.path.join(opt["out"], "scaling.csv"), "w", newline="") as os_:
+        w = csv.writer(os_)
+        w.writerow(["mode", "dim", "N", "threads", "phase", "ms", "max_thread_ms", "efficiency"])
+        for r, pt in rows:
+            w.writerow([mode, r["dim"], r["N"], r["threads"], "total", "%.3f" % (1e3 * r["seconds"]), "", "%.4f" % pt["efficiency"]])
+            for name, ph in sorted(r["phases"].items()):
+                eff = pt["phase_efficiency"].get(name)
+                w.writerow([mode, r["dim"], r["N"], r["threads"], name, "%.3f" % ph["ms"], "%.3f" % ph["max_thread_ms"],
+                            "" if eff is None else "%.4f" % eff])
+
+    print("\n%s scaling, efficiency relative to %d thread(s)" % (mode, min(grid["threads"])))
+    print("%6s %10s %8s %10s %14s %8s %6s" % ("dim", "N", "threads", "s/gen", "agent-steps/s", "speedup", "eff"))
+    for c in curves:
+        for pt in c["points"]:
+            print("%6d %10d %8d %10.3f %14.4g %8.2f %6.2f" % (c["dim"], pt["N"], pt["threads"], pt["seconds"],
+                                                             pt["agent_steps_per_s"], pt["speedup"], pt["efficiency"]))
+    print("\nreport: " + os.path.join(opt["out"], "scaling.json"))
+
+
+if __name__ == "__main__":
+    try:
+        main(sys.argv[1:])
+    except (ValueError, RuntimeError, OSError) as err:
+        print("scaling.py: %s" % err, file=sys.stderr)
+        sys.exit(1)
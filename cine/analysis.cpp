@@ -31,6 +31,7 @@ namespace cine2 {
 
 
   // returns {min, max, mean, stddev, mad}
+  // the sums run in row-major order for any layer layout
   Analysis::Input Analysis::reduce(const LayerView& view, LayerView& tmp)
   {
     const float* __restrict p = view.data();
@@ -38,20 +39,32 @@ namespace cine2 {
     float mini = +std::numeric_limits<float>::max();
     float maxi = -std::numeric_limits<float>::max();
     double sum = 0.0;
-    const int N = view.dim() * view.dim();
-    for (int i =0; i < N; ++i) {
-      const float val = p[i];
-      if (val < mini) mini = val;
-      if (val > maxi) maxi = val;
-      sum += val;
+    const int dim = view.dim();
+    const int tile = 1 << view.tile_shift();
+    const int N = dim * dim;
+    for (int y = 0; y < dim; ++y) {
+      for (int x = 0; x < dim; x += tile) {
+        const float* row = p + view.index(x, y);
+        for (int i = 0; i < tile; ++i) {
+          const float val = row[i];
+          if (val < mini) mini = val;
+          if (val > maxi) maxi = val;
+          sum += val;
+        }
+      }
     }
     const double mean = sum / N;
     double variance = 0.0;
     double mad = 0.0;
-    for (int i =0; i < N; ++i) {
-      const float val = p[i];
-      variance += (val - mean) * (val - mean);
-      mad += std::abs(val - mean);
+    for (int y = 0; y < dim; ++y) {
+      for (int x = 0; x < dim; x += tile) {
+        const float* row = p + view.index(x, y);
+        for (int i = 0; i < tile; ++i) {
+          const float val = row[i];
+          variance += (val - mean) * (val - mean);
+          mad += std::abs(val - mean);
+        }
+      }
     }
     return {
       mini, 
@@ -65,9 +78,9 @@ namespace cine2 {
   void Analysis::assess_input(const Simulation* sim) const
   {
     LayerView tmp = sim->landscape()[Landscape::Layers::temp];
-    input_[0][0].push_back( reduce(sim->landscape()[static_cast<Landscape::Layers>(sim->param().agents.input_layers[0])], tmp ) );
-    input_[0][1].push_back( reduce(sim->landscape()[static_cast<Landscape::Layers>(sim->param().agents.input_layers[1])], tmp) );
-    input_[0][2].push_back( reduce(sim->landscape()[static_cast<Landscape::Layers>(sim->param().agents.input_layers[2])], tmp) );
+    input_[0][0].push_back( reduce(sim->landscape().as_float(static_cast<Landscape::Layers>(sim->param().agents.input_layers[0])), tmp ) );
+    input_[0][1].push_back( reduce(sim->landscape().as_float(static_cast<Landscape::Layers>(sim->param().agents.input_layers[1])), tmp) );
+    input_[0][2].push_back( reduce(sim->landscape().as_float(static_cast<Landscape::Layers>(sim->param().agents.input_layers[2])), tmp) );
 
   }
 
@@ -81,7 +94,7 @@ namespace cine2 {
       if (x > 0.f) ++cfit;
     }
     std::set<int> unique_anc;
-    for (const auto& ind : Pop.pop) unique_anc.insert(ind.ancestor);
+    unique_anc.insert(Pop.pop.ancestor(), Pop.pop.ancestor() + Pop.pop.size());
     auto* tmp_ann = Pop.tmp_ann.get();
     double complexity = 0.0;
     std::set<float*, ann_cmp> unique_ann(ann_cmp(tmp_ann->state_size()));
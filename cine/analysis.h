@@ -8,6 +8,10 @@
 namespace cine2 {
 
 
+  template <typename T> class BasicLayerView;
+  using LayerView = BasicLayerView<float>;
+
+
   // used for the summary statistic
   class Analysis
   {
@@ -42,8 +46,15 @@ namespace cine2 {
     const std::array<std::vector<Input>, 3>& agents_input() const { return input_[0]; }
     //const std::array<std::vector<Input>, 3>& pred_input() const { return input_[1]; }
 
+    // restores the history, see Simulation::restore_checkpoint
+    void restore(std::vector<Summary> summary, std::array<std::vector<Input>, 3> input)
+    {
+      summary_[0] = std::move(summary);
+      input_[0] = std::move(input);
+    }
+
   private:
-    static Input reduce(const class LayerView& view, class LayerView& tmp);
+    static Input reduce(const LayerView& view, LayerView& tmp);
     void assess_input(const class Simulation* sim) const;
     Summary assess_summary(const struct Population& Pop) const;
 
@@ -11,6 +11,9 @@
 #include <algorithm>
 #include <array>
 #include <tuple>
+#include <limits>
+#include <cmath>
+#include <cstdint>
 #include <cassert>
 
 
@@ -18,6 +21,8 @@
     #define ann_assume_aligned(x, a) __assume_aligned(x, a)
 #elif defined(_MSC_VER)
     #define ann_assume_aligned(x, a) __assume((((char*)x) - ((char*) 0)) % (a) == 0)
+#elif defined(__GNUC__)
+    #define ann_assume_aligned(x, a) do { if ((reinterpret_cast<std::uintptr_t>(x) % (a)) != 0) __builtin_unreachable(); } while (0)
 #else
     #define ann_assume_aligned(x, a)
 #endif
@@ -26,11 +31,11 @@
 namespace ann {
 
 
-template <size_t size, size_t scratch = 0>
+template <size_t Size, size_t Scratch = 0>
 struct extra_state 
 {
-  static const size_t value = size;
-  static const size_t scratch = scratch;
+  static const size_t value = Size;
+  static const size_t scratch = Scratch;
 };
 
 
@@ -295,6 +300,34 @@ struct Neuron
     }
     return activation_t::apply(feedback_t::apply(u, state + feedback_begin, state + feedback_scratch_begin), state + activation_begin);
   }
+
+
+  //! \brief Feeds B inputs at once, structure of arrays: in[i][b]
+  //! Only defined for neurons without feedback scratch, their
+  //! output doesn't depend on the order of evaluation.
+  template <typename T, size_t B>
+  static void feed_batch(const std::array<std::array<T, B>, input_size>& in, 
+                         std::array<T, B>& out, 
+                         const T* __restrict const state)
+  {
+    static_assert(feedback_scratch == 0, "Neuron::feed_batch: stateful neuron");
+    T* __restrict pout = out.data();
+    const T bias = biased ? state[0] : T(0);
+    for (size_t b = 0; b < B; ++b) {
+      pout[b] = bias;
+    }
+    for (size_t i = 0; i < input_size; ++i) {
+      const T w = state[i + (biased ? 1 : 0)];
+      const T* __restrict pin = in[i].data();
+#     pragma omp simd
+      for (size_t b = 0; b < B; ++b) {
+        pout[b] += w * pin[b];
+      }
+    }
+    for (size_t b = 0; b < B; ++b) {
+      pout[b] = activation_t::apply(feedback_t::apply(pout[b], state + feedback_begin, state + feedback_scratch_begin), state + activation_begin);
+    }
+  }
 };
 
 
@@ -329,6 +362,18 @@ struct Layer
     return out;
   }
 
+  template <size_t Ofs, typename T, size_t B>
+  static void feed_batch(const std::array<std::array<T, B>, input_size>& in, 
+                         std::array<std::array<T, B>, output_size>& out, 
+                         const T* __restrict state)
+  {
+    ann_assume_aligned(state, 16);
+    state += Ofs;
+    for (size_t i = 0; i < output_size; ++i, state += neuron_t::state_size) {
+      neuron_t::feed_batch(in, out[i], state);
+    }
+  }
+
 };
 
 
@@ -407,10 +452,15 @@ public:
   static constexpr size_t input_size = input_layer_t::input_size;
   static constexpr size_t output_size = output_layer_t::output_size;
   static constexpr size_t state_size = detail::network_state_size<L...>::value;
+  static constexpr bool stateless = ((L::neuron_t::feedback_scratch == 0) && ...);  // output independent of call history
 
   using input_t = std::array<value_type, input_size>;
   using output_t = std::array<value_type, output_size>;
 
+  // B inputs/outputs in structure of arrays layout: in[input][b]
+  template <size_t B> using batch_input_t = std::array<std::array<value_type, B>, input_size>;
+  template <size_t B> using batch_output_t = std::array<std::array<value_type, B>, output_size>;
+
 
   Network()
   {
@@ -482,7 +532,35 @@ public:
   }
 
 
+  // feed forward B inputs at once, only for stateless networks.
+  // Same result as B calls to operator().
+  template <size_t B>
+  void feed_batch(const batch_input_t<B>& in, batch_output_t<B>& out) const
+  {
+    static_assert(stateless, "Network::feed_batch: network with feedback");
+    do_feed_batch<0, B>(in, out);
+  }
+
+
 private:
+  template <size_t I, size_t B>
+  auto do_feed_batch(const std::array<std::array<value_type, B>, std::tuple_element_t<I, layer_t>::input_size>& in, batch_output_t<B>& out) const
+    -> std::enable_if_t<(I == output_layer)>
+  {
+    std::tuple_element_t<I, layer_t>::template feed_batch<detail::accum_state_ofs<I, layer_t>::value>(in, out, state_.data());
+  }
+
+
+  template <size_t I, size_t B>
+  auto do_feed_batch(const std::array<std::array<value_type, B>, std::tuple_element_t<I, layer_t>::input_size>& in, batch_output_t<B>& out) const
+    -> std::enable_if_t<(I < output_layer)>
+  {
+    std::array<std::array<value_type, B>, std::tuple_element_t<I, layer_t>::output_size> hidden;
+    std::tuple_element_t<I, layer_t>::template feed_batch<detail::accum_state_ofs<I, layer_t>::value>(in, hidden, state_.data());
+    do_feed_batch<I + 1, B>(hidden, out);
+  }
+
+
   template <size_t I>
   auto do_feed_forward(const std::array<value_type, std::tuple_element_t<I, layer_t>::input_size>& in)
     -> std::enable_if_t<(I == output_layer), output_t>
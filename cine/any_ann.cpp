@@ -1,6 +1,8 @@
 #include <stdexcept>
+#include <cstring>
 #include "any_ann.hpp"
 #include "simulation.h"
+#include "profiler.h"
 
 
 namespace cine2 {
@@ -26,67 +28,86 @@ namespace cine2 {
 
   namespace ann_visitors {
 
-    struct mutate
+    // Collects the offsets of the mutation sites of a network.
+    // Node 1 is the strategy node of every layer: its first weight flips
+    // sign and is exempt from steps and knockouts in obligate mode.
+    struct mutation_sites
     {
-      mutate(const Param::ind_param& iparam, bool Fixed)
-        : mdist(iparam.mutation_prob),
-        sdist(0.0f, iparam.mutation_step),
-        kdist(iparam.mutation_knockout),
-        fixed(Fixed), obligate(iparam.obligate)
-      {
-      }
+      explicit mutation_sites(const float* Base) : base(Base) {}
 
       template <typename Neuron, typename T>
-      void operator()(T* state, size_t layer, size_t node) const
+      void operator()(T* state, size_t layer, size_t node)
       {
-        if (!fixed) {
-          for (int w = 0; w < Neuron::total_weights; ++w) {
-            if (mdist(rnd::reng)) { if (!obligate || node != 1 || w != 0) { state[w] += sdist(rnd::reng); } }
-            if (kdist(rnd::reng)) { if (!obligate || node != 1 || w != 0) { state[w] = 0.f; } }
-          }
-        }
-
-        if (node == 1) {
-          if (mdist(rnd::reng)) { state[0] *= -1.f; }
+        const int ofs = static_cast<int>(state - base);
+        for (int w = 0; w < Neuron::total_weights; ++w) {
+          weights.push_back(ofs + w);
+          if (node != 1 || w != 0) obligate_weights.push_back(ofs + w);
         }
-        // clear feedback scratch
+        if (node == 1) flips.push_back(ofs);
         for (int s = Neuron::feedback_scratch_begin; s < Neuron::state_size; ++s) {
-          state[s] = 0.f;
+          scratch.push_back(ofs + s);
         }
       }
 
-      const std::bernoulli_distribution mdist;
-      const std::cauchy_distribution<float> sdist;
-      const std::bernoulli_distribution kdist;
-      bool fixed;
-      int obligate;
+      const float* base;
+      std::vector<int> weights;             // all weights
+      std::vector<int> obligate_weights;    // weights without the node 1 signs
+      std::vector<int> flips;               // node 1 signs
+      std::vector<int> scratch;             // feedback scratch
     };
 
+
+    // Mutates one genome. Same distribution as a Bernoulli trial per
+    // site: Cauchy steps with mutation_prob and knockouts with
+    // mutation_knockout (unless fixed), sign flips of node 1 with
+    // mutation_prob. The gaps between hits are geometric, the cost is
+    // proportional to the number of hits.
+    template <typename URNG>
+    void sparse_mutate(float* genome, const mutation_sites& sites, const Param::ind_param& iparam, bool fixed, URNG& reng)
+    {
+      auto for_each_hit = [&reng](const std::vector<int>& sites, double p, auto&& fun) {
+        const uint64_t n = sites.size();
+        for (uint64_t k = rndutils::geometric_skip(p, reng); k < n; k += 1 + rndutils::geometric_skip(p, reng)) {
+          fun(sites[k]);
+        }
+      };
+      if (!fixed) {
+        const auto& weights = iparam.obligate ? sites.obligate_weights : sites.weights;
+        std::cauchy_distribution<float> sdist(0.0f, iparam.mutation_step);
+        for_each_hit(weights, iparam.mutation_prob, [&](int w) { genome[w] += sdist(reng); });
+        for_each_hit(weights, iparam.mutation_knockout, [&](int w) { genome[w] = 0.f; });
+      }
+      for_each_hit(sites.flips, iparam.mutation_prob, [&](int w) { genome[w] *= -1.f; });
+      // clear feedback scratch
+      for (int s : sites.scratch) genome[s] = 0.f;
+    }
+
     struct initialize
     {
-      initialize(const Param::ind_param& iparam)
+      initialize(const Param::ind_param& iparam, rnd::stream_engine Reng)
         : sdist(0.0f, iparam.mutation_step), 
-        obligate(iparam.obligate)
+        obligate(iparam.obligate),
+        reng(Reng)
       {
       }
 
       template <typename Neuron, typename T>
-      void operator()(T* state, size_t layer, size_t node) const
+      void operator()(T* state, size_t layer, size_t node)
       {
-
         for (int w = 0; w < Neuron::total_weights; ++w) {
-          state[w] += sdist(rnd::reng);
+          state[w] += sdist(reng);
 
 
         }
           if (obligate && (node == 1)) {
-            state[0] = (std::bernoulli_distribution(0.5)(rnd::reng)) ? -1.f : 1.f;
+            state[0] = (std::bernoulli_distribution(0.5)(reng)) ? -1.f : 1.f;
           }
 
       }
 
-      const std::cauchy_distribution<float> sdist;
+      std::cauchy_distribution<float> sdist;
       const int obligate;
+      rnd::stream_engine reng;
     };
 
     struct initialize2
@@ -129,8 +150,29 @@ namespace cine2 {
   {
     static_assert(std::is_trivially_copyable<ANN>::value, "Who messed with the Ann class?");
 
+    // strategy output, 0 for single output Anns
+    static float second_output(const typename ANN::output_t& output)
+    {
+      if constexpr (ANN::output_size > 1) return output[1]; else return 0.f;
+    }
+
+    template <size_t B>
+    static float second_output(const typename ANN::template batch_output_t<B>& output, int i)
+    {
+      if constexpr (ANN::output_size > 1) return output[1][i]; else return 0.f;
+    }
+
+    static ann_visitors::mutation_sites make_mutation_sites()
+    {
+      auto proto = std::make_unique<ANN>();
+      ann_visitors::mutation_sites sites(proto->cbegin());
+      ann::visit_neurons(*proto, sites);
+      return sites;
+    }
+
   public:
-    explicit concrete_ann(int N) : any_ann(N, ANN::state_size, sizeof(ANN))
+    explicit concrete_ann(int N) : any_ann(N, ANN::state_size, sizeof(ANN)),
+      mutation_sites_(make_mutation_sites())
     {
     }
 
@@ -145,8 +187,9 @@ namespace cine2 {
 
 
     void move(const Landscape& landscape,
-      std::vector<Individual>& pop,
-      const Param::ind_param& iparam) override
+      Individuals& pop,
+      const Param::ind_param& iparam,
+      const rnd::streams& rs) override
     {
       using Layers = Landscape::Layers;
       using env_info_t = std::array<float, L * L>;
@@ -160,96 +203,134 @@ namespace cine2 {
 
       ANN* __restrict pann = reinterpret_cast<ANN*>(state_);
       const int N = static_cast<int>(iparam.N);
-      const auto noise = std::uniform_real_distribution<float>(1.0f - iparam.noise_sigma, 1.0f + iparam.noise_sigma);
-#   pragma omp parallel for schedule(static,128)
-      for (int p = 0; p < N; ++p) {							//cycle thrugh the agents
-        if (pop[p].alive() && !(pop[p].handle())) {			//conditions for movement (alive and not handling)
+      const float noise_lo = 1.0f - iparam.noise_sigma;
+      const float noise_hi = 1.0f + iparam.noise_sigma;
+#   pragma omp parallel
+      {
+        profiler::scope prof(profiler::phase::move_thread);
+#       pragma omp for schedule(static,128)
+        for (int p = 0; p < N; ++p) {							//cycle thrugh the agents
+          auto reng = rs(rnd::purpose::move, p);
+          if (pop[p].alive() && !(pop[p].handle())) {			//conditions for movement (alive and not handling)
+            // noise factors of all cells and inputs in one go, noise[cell][input]
+            alignas(64) std::array<float, L * L * ANN::input_size> noise;
+            rndutils::generate_uniform(reng, noise.data(), noise.size(), noise_lo, noise_hi);
+
+        //gather information from landscape
+            Coordinate pos = pop[p].pos();							//gather position agent
+            std::array<env_info_t, ANN::input_size> env_input;	//[input number definition stuff]
+            for (int i = 0; i < ANN::input_size; ++i) {			//for cycle through inputs [4][can be changed]
+              env_input[i] = landscape.gather<L>(static_cast<Layers>(iparam.input_layers[i]), pos);	//inputs are gathered from the first n layer in "landscape" at the position "pos"
 
-      //gather information from landscape
-          Coordinate pos = pop[p].pos;							//gather position agent
-          std::array<env_info_t, ANN::input_size> env_input;	//[input number definition stuff]
-          for (int i = 0; i < ANN::input_size; ++i) {			//for cycle through inputs [4][can be changed]
-            env_input[i] = landscape[static_cast<Layers>(iparam.input_layers[i])].gather<L>(pos);	//inputs are gathered from the first n layer in "landscape" at the position "pos"
+            }
 
-          }
+            // reflect about the possible cells (we are still in the agents for-cycle)
+            float best_eval = -std::numeric_limits<float>::max();
+            std::array<zip_eval_cell, L * L> zip;
+            if constexpr (ANN::stateless) {
+              // evaluate all candidate cells in one batch
+              typename ANN::template batch_input_t<L * L> input;
+              typename ANN::template batch_output_t<L * L> output;
+              for (int i = 0; i < L * L; ++i) {
+                for (int j = 0; j < ANN::input_size; ++j) {
+                  input[j][i] = iparam.input_mask[j] * noise[i * ANN::input_size + j] * (env_input[j][i]);
+                }
+              }
+              pann[p].feed_batch(input, output);   // ask ANN
+
+              // obligate: strategy from the bias of the second node, same for all cells
+              float eval2_obligate = 0.f;
+              if (iparam.obligate) {
+                eval2_obligate = second_output(pann[p](typename ANN::input_t{}));
+              }
+              for (int i = 0; i < L * L; ++i) {
+                const float eval = output[0][i];			//first output, named eval
+                const float eval2 = iparam.obligate ? eval2_obligate : second_output(output, i);
+                best_eval = std::max(best_eval, eval);		//best_eval is updated,
+                zip[i] = { eval, eval2, i };				//structure filled with evaluation
+              }
+            }
+            else {
+              // feedback: evaluation order matters
+              typename ANN::input_t input;
+              typename ANN::input_t input2; //To get bias of second node
+              for (int i = 0; i < L * L; ++i) {
+                for (int j = 0; j < ANN::input_size; ++j) {
 
-          // reflect about the possible cells (we are still in the agents for-cycle)
-          float best_eval = -std::numeric_limits<float>::max();
-          typename ANN::input_t input;
-          typename ANN::input_t input2; //To get bias of second node
-          std::array<zip_eval_cell, L * L> zip;
-          for (int i = 0; i < L * L; ++i) {
-            for (int j = 0; j < ANN::input_size; ++j) {
+                  input[j] = iparam.input_mask[j] * noise[i * ANN::input_size + j] * (env_input[j][i]);
+                  input2[j] = 0.f;
 
-              input[j] = iparam.input_mask[j] * noise(rnd::reng) * (env_input[j][i]);
-              input2[j] = 0.f;
+                }
 
-            }
+                auto output = pann[p](input);   // ask ANN
+                float eval = output[0];			//first output, named eval
+                float eval2;
 
-            auto output = pann[p](input);   // ask ANN
-            float eval = output[0];			//first output, named eval
-            float eval2;
+                if (iparam.obligate) {
+                  auto output2 = pann[p](input2);   // ask ANN
+                  eval2 = second_output(output2);		//second output, named eval2
 
-            if (iparam.obligate) {
-              auto output2 = pann[p](input2);   // ask ANN
-              eval2 = output2[1];		//second output, named eval2
+                }
+                else {
+                  eval2 = second_output(output);
+                }
 
-            }
-            else {
-              eval2 = output[1];
+                best_eval = std::max(best_eval, eval);		//best_eval is updated,
+                zip[i] = { eval, eval2, i };				//structure filled with evaluation
+              }
             }
 
-            best_eval = std::max(best_eval, eval);		//best_eval is updated,
-            zip[i] = { eval, eval2, i };				//structure filled with evaluation
-          }
+            // resolve ambiguities. bring 'best' ones to the front
+            auto it = std::partition(zip.begin(), zip.end(), [=](const auto& a) { return a.eval == best_eval; }) - 1;
+            if (it != zip.begin()) {
+              // yep, more than one 'best' alternatives, select one at random
+              it = zip.begin() + rndutils::uniform_signed_distribution<int>(0, static_cast<int>(std::distance(zip.begin(), it)))(reng);
+            }
+            pop[p].pos() = landscape.wrap(pos + Coordinate{ short((it->cell % L) - L / 2), short((it->cell / L) - L / 2) });
+
+            /*
+        double s_prob = 1.0 / (1.0 + exp(-static_cast<double> (it->eval2)));	//creating s_prob which is function of eval2
+            std::bernoulli_distribution s_decision(s_prob);							//this become the probability of adopting foraging strategy
+        pop[p].forage = s_decision(rnd::reng);				//if condition apply, foraging of agent set to TRUE
+        */
+            if (iparam.forage) {
+              pop[p].forage(true);
+            }
+            else {
+              pop[p].forage(it->eval2 >= 0);
 
-          // resolve ambiguities. bring 'best' ones to the front
-          auto it = std::partition(zip.begin(), zip.end(), [=](const auto& a) { return a.eval == best_eval; }) - 1;
-          if (it != zip.begin()) {
-            // yep, more than one 'best' alternatives, select one at random
-            it = zip.begin() + rndutils::uniform_signed_distribution<int>(0, static_cast<int>(std::distance(zip.begin(), it)))(rnd::reng);
-          }
-          pop[p].pos = landscape.wrap(pos + Coordinate{ short((it->cell % L) - L / 2), short((it->cell / L) - L / 2) });
-
-          /*
-      double s_prob = 1.0 / (1.0 + exp(-static_cast<double> (it->eval2)));	//creating s_prob which is function of eval2
-          std::bernoulli_distribution s_decision(s_prob);							//this become the probability of adopting foraging strategy
-      pop[p].forage = s_decision(rnd::reng);				//if condition apply, foraging of agent set to TRUE
-      */
-          if (iparam.forage) {
-            pop[p].forage(true);
-          }
-          else {
-            pop[p].forage(it->eval2 >= 0);
+            }
 
           }
-
         }
       }
     }
 
 
-    void mutate(const Param::ind_param& iparam, bool fixed) override
+    void mutate(const Param::ind_param& iparam, bool fixed, const rnd::streams& rs) override
     {
       ANN* __restrict pann = reinterpret_cast<ANN*>(state_);
       const int N = static_cast<int>(iparam.N);
-      const ann_visitors::mutate mutate_visitor(iparam, fixed);
 #   pragma omp parallel for schedule(static, 128)
       for (int i = 0; i < N; ++i) {
-        ann::visit_neurons(pann[i], mutate_visitor);
+        auto reng = rs(rnd::purpose::mutate, i);
+        ann_visitors::sparse_mutate(pann[i].begin(), mutation_sites_, iparam, fixed, reng);
       }
     }
 
-    void initialize(const Param::ind_param& iparam) override
+    void initialize(const Param::ind_param& iparam, const rnd::streams& rs) override
     {
       ANN* __restrict pann = reinterpret_cast<ANN*>(state_);
       const int N = static_cast<int>(iparam.N);
-      const ann_visitors::initialize init_visitor(iparam);
 #   pragma omp parallel for schedule(static, 128)
       for (int i = 0; i < N; ++i) {
+        ann_visitors::initialize init_visitor(iparam, rs(rnd::purpose::init_ann, i));
         ann::visit_neurons(pann[i], init_visitor);
       }
     }
+
+  private:
+    const ann_visitors::mutation_sites mutation_sites_;
   };
 
 
@@ -280,8 +361,7 @@ namespace cine2 {
     if (L == 33) return make_any_ann_1<33>(N, ann_descr);
 
     // ToDo: add your Anns here
-    std::runtime_error("Unknown Ann type");
-    return nullptr;
+    throw std::runtime_error("Unknown Ann type");
   }
 
 
@@ -2,6 +2,7 @@
 #define CINE2_ANY_ANN_HPP_INCLUDED
 
 #include <memory>
+#include <cstring>
 #include <algorithm>
 #include <functional>
 #include <vector>
@@ -50,9 +51,9 @@ namespace cine2 {
 
     // Returns complexity of ann idx: 1 - (zero / weights)
     virtual float complexity(int idx) const = 0;
-    virtual void move(const Landscape& landscape, std::vector<Individual>& pop, const Param::ind_param& iparam) = 0;
-    virtual void mutate(const Param::ind_param& iparam, bool fixed) = 0;
-    virtual void initialize(const Param::ind_param& iparam) = 0;
+    virtual void move(const Landscape& landscape, Individuals& pop, const Param::ind_param& iparam, const rnd::streams& rs) = 0;
+    virtual void mutate(const Param::ind_param& iparam, bool fixed, const rnd::streams& rs) = 0;
+    virtual void initialize(const Param::ind_param& iparam, const rnd::streams& rs) = 0;
 
   protected:
     int N_;
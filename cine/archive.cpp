@@ -1,45 +1,347 @@
 #include "archive.hpp"
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
 #include <zlib/zlib.h>
+#include <lz4/lz4.h>
+
+#if defined(_WIN32)
+# ifndef NOMINMAX
+#   define NOMINMAX
+# endif
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
 
 
 namespace archive {
 
 
-  compressed_mem compress(const void* source, const size_t n, const size_t size, size_t stride)
+  namespace {
+
+    const int32_t magic_v1 = 0x49484148;    // little endian ascii: 'HAHI'
+    const int32_t magic_v2 = 0x32484148;    // little endian ascii: 'HAH2', per blob codec
+    const int32_t magic_v3 = 0x33484148;    // little endian ascii: 'HAH3', framed blobs
+    const uint32_t frame_magic = 0x424F4C42;  // little endian ascii: 'BLOB'
+
+#   pragma pack(push, 1)
+    struct dict_v1
+    {
+      uint64_t ppos;
+      uint32_t csize;
+      uint32_t un;
+      uint32_t usize;
+    };
+#   pragma pack(pop)
+
+
+    void check_magic(int32_t magic)
+    {
+      if (magic == 0x41484948 || magic == 0x41484832 || magic == 0x41484833) throw std::runtime_error("oarch: invalid endianness");
+      if (magic != magic_v1 && magic != magic_v2 && magic != magic_v3) throw std::runtime_error("oarch: corrupt archive");
+    }
+
+
+    // appends the complete frames in [pos, end) to dict, returns the end of the last one.
+    // read(pos, dst, bytes) reads from the archive.
+    template <typename Read>
+    uint64_t scan_frames(Read&& read, uint64_t pos, uint64_t end, std::vector<dict>& dict)
+    {
+      frame f;
+      while (pos + sizeof(frame) <= end) {
+        read(pos, &f, sizeof(frame));
+        if (f.magic != frame_magic || pos + sizeof(frame) + f.csize > end) break;
+        dict.push_back({ pos + sizeof(frame), f.csize, f.un, f.usize, f.codec_id, f.filters, f.typesize, 0 });
+        pos += sizeof(frame) + f.csize;
+      }
+      return pos;
+    }
+
+
+    uint32_t checksum(const unsigned char* buf, uint32_t bytes)
+    {
+      return static_cast<uint32_t>(::crc32(::crc32(0L, Z_NULL, 0), buf, bytes));
+    }
+
+
+    void check_frame(const frame& f, const dict& d, const unsigned char* cbuf)
+    {
+      if (f.magic != frame_magic || f.csize != d.csize || f.crc != checksum(cbuf, d.csize)) {
+        throw std::runtime_error("oarch: corrupt blob");
+      }
+    }
+
+
+    dict upgrade(const dict_v1& d)
+    {
+      return { d.ppos, d.csize, d.un, d.usize, codec::deflate, no_filter, 1, 0 };
+    }
+
+
+    size_t deflate_bound(size_t bytes)
+    {
+      return ::compressBound(static_cast<uLong>(bytes));
+    }
+
+    size_t deflate_compress(unsigned char* dst, size_t cap, const unsigned char* src, size_t bytes, int level)
+    {
+      uLong destLen = static_cast<uLong>(cap);
+      const int res = ::compress2(dst, &destLen, src, static_cast<uLong>(bytes), level);
+      if (res == Z_BUF_ERROR) return 0;
+      if (res != Z_OK) throw std::runtime_error("deflate: compression failed");
+      return destLen;
+    }
+
+    void deflate_uncompress(unsigned char* dst, size_t bytes, const unsigned char* src, size_t csize)
+    {
+      uLong destLen = static_cast<uLong>(bytes);
+      if (Z_OK != ::uncompress(dst, &destLen, src, static_cast<uLong>(csize)) || destLen != bytes) {
+        throw std::runtime_error("deflate: decompression failed");
+      }
+    }
+
+    size_t lz4_bound(size_t bytes)
+    {
+      if (bytes > LZ4_MAX_INPUT_SIZE) throw std::runtime_error("lz4: blob too large");
+      return static_cast<size_t>(LZ4_compressBound(static_cast<int>(bytes)));
+    }
+
+    size_t lz4_compress(unsigned char* dst, size_t cap, const unsigned char* src, size_t bytes, int)
+    {
+      const int cap_i = static_cast<int>(std::min<size_t>(cap, 0x7FFFFFFF));
+      return static_cast<size_t>(LZ4_compress_default((const char*)src, (char*)dst, static_cast<int>(bytes), cap_i));
+    }
+
+    void lz4_uncompress(unsigned char* dst, size_t bytes, const unsigned char* src, size_t csize)
+    {
+      if (static_cast<size_t>(LZ4_decompress_safe((const char*)src, (char*)dst, static_cast<int>(csize), static_cast<int>(bytes))) != bytes) {
+        throw std::runtime_error("lz4: decompression failed");
+      }
+    }
+
+    size_t store_bound(size_t bytes)
+    {
+      return bytes;
+    }
+
+    size_t store_compress(unsigned char* dst, size_t cap, const unsigned char* src, size_t bytes, int)
+    {
+      if (cap < bytes) return 0;
+      std::memcpy(dst, src, bytes);
+      return bytes;
+    }
+
+    void store_uncompress(unsigned char* dst, size_t bytes, const unsigned char* src, size_t csize)
+    {
+      if (csize != bytes) throw std::runtime_error("store: decompression failed");
+      std::memcpy(dst, src, bytes);
+    }
+
+    // by codec id
+    const codec_info codecs[] = {
+      { "deflate", deflate_bound, deflate_compress, deflate_uncompress },
+      { "lz4", lz4_bound, lz4_compress, lz4_uncompress },
+      { "store", store_bound, store_compress, store_uncompress },
+    };
+
+
+    // dst[b * m + i] = src[i * ts + b] for m = bytes / ts elements, the tail is copied
+    void byte_shuffle(unsigned char* __restrict dst, const unsigned char* __restrict src, size_t bytes, size_t ts)
+    {
+      if (bytes == 0) return;
+      const size_t m = bytes / ts;
+      for (size_t b = 0; b < ts; ++b) {
+        for (size_t i = 0; i < m; ++i) {
+          dst[b * m + i] = src[i * ts + b];
+        }
+      }
+      std::memcpy(dst + m * ts, src + m * ts, bytes - m * ts);
+    }
+
+    void byte_unshuffle(unsigned char* __restrict dst, const unsigned char* __restrict src, size_t bytes, size_t ts)
+    {
+      if (bytes == 0) return;
+      const size_t m = bytes / ts;
+      for (size_t b = 0; b < ts; ++b) {
+        for (size_t i = 0; i < m; ++i) {
+          dst[i * ts + b] = src[b * m + i];
+        }
+      }
+      std::memcpy(dst + m * ts, src + m * ts, bytes - m * ts);
+    }
+
+    // transposes the 8x8 bit matrix of 8 bytes: bit j of byte i <-> bit i of byte j
+    uint64_t transpose8(uint64_t x)
+    {
+      uint64_t t;
+      t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;  x = x ^ t ^ (t << 7);
+      t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull; x = x ^ t ^ (t << 14);
+      t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull; x = x ^ t ^ (t << 28);
+      return x;
+    }
+
+    // bit planes of the byte planes of the byte-shuffled src in tmp:
+    // plane b of m bytes holds 8 rows of m / 8 bytes, row k = bit k
+    void bit_shuffle(unsigned char* __restrict dst, const unsigned char* src, size_t bytes, size_t ts, unsigned char* __restrict tmp)
+    {
+      if (bytes == 0) return;
+      byte_shuffle(tmp, src, bytes, ts);
+      const size_t m = bytes / ts;
+      const size_t g = m / 8;
+      for (size_t b = 0; b < ts; ++b) {
+        const unsigned char* plane = tmp + b * m;
+        unsigned char* out = dst + b * m;
+        for (size_t j = 0; j < g; ++j) {
+          uint64_t x;
+          std::memcpy(&x, plane + 8 * j, 8);
+          x = transpose8(x);
+          for (size_t k = 0; k < 8; ++k) {
+            out[k * g + j] = static_cast<unsigned char>(x >> (8 * k));
+          }
+        }
+        std::memcpy(out + 8 * g, plane + 8 * g, m - 8 * g);
+      }
+      std::memcpy(dst + m * ts, tmp + m * ts, bytes - m * ts);
+    }
+
+    void bit_unshuffle(unsigned char* __restrict dst, const unsigned char* src, size_t bytes, size_t ts, unsigned char* __restrict tmp)
+    {
+      if (bytes == 0) return;
+      const size_t m = bytes / ts;
+      const size_t g = m / 8;
+      for (size_t b = 0; b < ts; ++b) {
+        const unsigned char* in = src + b * m;
+        unsigned char* plane = tmp + b * m;
+        for (size_t j = 0; j < g; ++j) {
+          uint64_t x = 0;
+          for (size_t k = 0; k < 8; ++k) {
+            x |= uint64_t(in[k * g + j]) << (8 * k);
+          }
+          x = transpose8(x);
+          std::memcpy(plane + 8 * j, &x, 8);
+        }
+        std::memcpy(plane + 8 * g, in + 8 * g, m - 8 * g);
+      }
+      std::memcpy(tmp + m * ts, src + m * ts, bytes - m * ts);
+      byte_unshuffle(dst, tmp, bytes, ts);
+    }
+
+    void xor_bytes(unsigned char* __restrict dst, const unsigned char* __restrict prev, size_t bytes)
+    {
+      for (size_t i = 0; i < bytes; ++i) {
+        dst[i] ^= prev[i];
+      }
+    }
+
+  }
+
+
+  const codec_info& get_codec(codec id)
   {
-    const uLong bytes = static_cast<uLong>(n * size);
-    uLong destLen = static_cast<uLong>(1.1 * bytes + 128);
-    auto dst = compressed_mem::buffer((unsigned char*)std::malloc(destLen), std::free);
+    const size_t i = static_cast<size_t>(id);
+    if (i >= sizeof(codecs) / sizeof(codecs[0])) throw std::runtime_error("archive: unknown codec");
+    return codecs[i];
+  }
+
+
+  compressed_mem compress(const void* source, const size_t n, const size_t size, size_t stride, const codec_param& cp, const void* prev)
+  {
+    const size_t bytes = n * size;
+    const size_t ts = std::max<size_t>(1, cp.typesize);
+    uint8_t filters = cp.filters & (shuffle | bitshuffle);
+    if (filters == (shuffle | bitshuffle)) filters = bitshuffle;
+    if (prev) filters |= xor_delta;
     stride = stride ? stride : size;
-    const uLong sourceLen = bytes;
-    int Z_RES;
-    if (stride == size) {
-      Z_RES = ::compress(dst.get(), &destLen, (const Bytef*)source, sourceLen);
+    if (bytes == 0) {
+      // empty blob, e.g. a timestep without conflicts
+      auto dst = compressed_mem::buffer((unsigned char*)std::malloc(1), std::free);
+      if (!dst) throw std::bad_alloc();
+      return {static_cast<uint32_t>(n), static_cast<uint32_t>(size), 0, std::move(dst), codec::store, filters, static_cast<uint8_t>((filters & (shuffle | bitshuffle)) ? ts : 1)};
     }
-    else {
-      std::vector<unsigned char> ibuf(bytes);
-      for (size_t i = 0; i < n; ++i) {
-        std::memcpy(ibuf.data() + i * size, (const char*)source + i * stride, size);
+
+    // filter stages, source -> buf
+    const unsigned char* src = (const unsigned char*)source;
+    std::vector<unsigned char> buf, tmp;
+    if (stride != size || filters) {
+      buf.resize(bytes);
+      if (stride == size) {
+        std::memcpy(buf.data(), source, bytes);
+      }
+      else {
+        for (size_t i = 0; i < n; ++i) {
+          std::memcpy(buf.data() + i * size, (const char*)source + i * stride, size);
+        }
       }
-      Z_RES = ::compress(dst.get(), &destLen, (const Bytef*)ibuf.data(), sourceLen);
+      src = buf.data();
+    }
+    if (filters & xor_delta) {
+      xor_bytes(buf.data(), (const unsigned char*)prev, bytes);
     }
-    if (Z_OK != Z_RES) {
-      throw std::runtime_error("compression failed");
+    if (filters & (shuffle | bitshuffle)) {
+      tmp.resize(bytes);
+      if (filters & bitshuffle) {
+        std::vector<unsigned char> tmp2(bytes);
+        bit_shuffle(tmp.data(), buf.data(), bytes, ts, tmp2.data());
+      }
+      else {
+        byte_shuffle(tmp.data(), buf.data(), bytes, ts);
+      }
+      src = tmp.data();
     }
-    return {static_cast<uint32_t>(n), static_cast<uint32_t>(size), destLen, std::move(dst)};
+
+    // codec, falls back to store if the blob doesn't shrink
+    codec id = cp.id;
+    const auto& ci = get_codec(id);
+    size_t cap = ci.bound(bytes);
+    auto dst = compressed_mem::buffer((unsigned char*)std::malloc(std::max<size_t>(1, cap)), std::free);
+    if (!dst) throw std::bad_alloc();
+    size_t csize = ci.compress(dst.get(), cap, src, bytes, cp.level);
+    if (csize == 0 || csize >= bytes) {
+      id = codec::store;
+      csize = store_compress(dst.get(), cap, src, bytes, 0);
+      if (csize != bytes) throw std::runtime_error("compression failed");
+    }
+    return {static_cast<uint32_t>(n), static_cast<uint32_t>(size), static_cast<uint32_t>(csize), std::move(dst), id, filters, static_cast<uint8_t>((filters & (shuffle | bitshuffle)) ? ts : 1)};
   }
 
 
-  void uncompress(void* dst, const compressed_mem& src, size_t stride)
+  void uncompress(void* dst, const compressed_view& src, size_t stride, const void* prev)
   {
-    uLong destLen = static_cast<uLong>(src.un * src.usize + 128);
-    std::vector<unsigned char> ubuf(destLen);
-    if (Z_OK != ::uncompress(ubuf.data(), &destLen, (const Bytef*)src.cbuf.get(), src.csize)) {
-      throw std::runtime_error("decmpression failed");
+    const size_t bytes = size_t(src.un) * src.usize;
+    if (bytes == 0) return;
+    if ((src.filters & xor_delta) && !prev) throw std::runtime_error("uncompress: xor_delta blob without reference");
+    const auto& ci = get_codec(src.codec_id);
+    if ((stride == 0 || src.usize == stride) && !(src.filters & (shuffle | bitshuffle))) {
+      // straight into dst
+      ci.uncompress((unsigned char*)dst, bytes, src.cbuf, src.csize);
+      if (src.filters & xor_delta) {
+        xor_bytes((unsigned char*)dst, (const unsigned char*)prev, bytes);
+      }
+      return;
+    }
+    std::vector<unsigned char> ubuf(bytes);
+    ci.uncompress(ubuf.data(), bytes, src.cbuf, src.csize);
+    if (src.filters & (shuffle | bitshuffle)) {
+      std::vector<unsigned char> tmp(bytes);
+      if (src.filters & bitshuffle) {
+        std::vector<unsigned char> tmp2(bytes);
+        bit_unshuffle(tmp.data(), ubuf.data(), bytes, src.typesize, tmp2.data());
+      }
+      else {
+        byte_unshuffle(tmp.data(), ubuf.data(), bytes, src.typesize);
+      }
+      ubuf.swap(tmp);
+    }
+    if (src.filters & xor_delta) {
+      xor_bytes(ubuf.data(), (const unsigned char*)prev, bytes);
     }
     if (stride == 0 || src.usize == stride) {
-      std::memcpy(dst, ubuf.data(), static_cast<uLong>(src.un) * src.usize);
+      std::memcpy(dst, ubuf.data(), bytes);
     }
     else {
       for (size_t i = 0; i < src.un; ++i) {
@@ -49,9 +351,9 @@ namespace archive {
   }
 
 
-  oarch::oarch(const fs::path& file, const std::string& header)
+  oarch::oarch(const fs::path& file, const std::string& header, const codec_param& cp)
   {
-    open(file, header);
+    open(file, header, cp);
   }
 
 
@@ -61,7 +363,7 @@ namespace archive {
   }
 
 
-  void oarch::open(const fs::path& file, const std::string& header)
+  void oarch::open(const fs::path& file, const std::string& header, const codec_param& cp)
   {
     if (header.empty() || header.size() > 255) throw std::runtime_error("oarch: invalid header");
     if (fb_.is_open()) close();
@@ -69,7 +371,7 @@ namespace archive {
     if (!fb_.is_open()) throw std::runtime_error("can't create oarch");
 
     // insert magic number for endianness test
-    int32_t magic = 0x49484148;   // little endian ascii: 'HAHI'
+    int32_t magic = magic_v3;
     fb_.sputn((char*)&magic, 4);
 
     // insert placeholder for dictionary offset
@@ -80,7 +382,38 @@ namespace archive {
     unsigned char header_size = static_cast<unsigned char>(header.size());
     fb_.sputc(header_size);
     fb_.sputn(header.data(), header_size);
+    fb_.pubsync();
     dict_.clear();
+    cp_ = cp;
+    framed_ = true;
+  }
+
+
+  void oarch::append(const fs::path& file, const std::string& header, size_t n, const codec_param& cp)
+  {
+    if (fb_.is_open()) close();
+    uint64_t pend = 0;
+    {
+      iarch ia(file);
+      if (ia.header() != header) throw std::runtime_error("oarch: header mismatch");
+      if (ia.size() < n) throw std::runtime_error("oarch: too few blobs to append to");
+      dict_ = ia.dict_;
+      dict_.resize(n);
+      pend = n ? dict_.back().ppos + dict_.back().csize : 13 + header.size();
+      framed_ = ia.framed_;
+    }
+    // drop the old dictionary and the blobs beyond n
+    fs::resize_file(file, pend);
+    fb_.open(file, std::ios::in | std::ios::out | std::ios::binary);
+    if (!fb_.is_open()) throw std::runtime_error("can't open oarch");
+    // version 1 archives are converted by the version 2 dictionary,
+    // the dictionary offset is reset until close
+    int32_t magic = framed_ ? magic_v3 : magic_v2;
+    fb_.sputn((char*)&magic, 4);
+    uint64_t dictofs(0);
+    fb_.sputn((char*)&dictofs, 8);
+    fb_.pubsync();
+    cp_ = cp;
   }
 
 
@@ -104,8 +437,14 @@ namespace archive {
    void oarch::insert(const compressed_mem& cm)
    {
      uint64_t pend = fb_.pubseekoff(0, std::ios_base::end);
+     if (framed_) {
+       const frame f = { frame_magic, cm.csize, cm.un, cm.usize, cm.codec_id, cm.filters, cm.typesize, 0, checksum(cm.cbuf.get(), cm.csize) };
+       fb_.sputn((const char*)&f, sizeof(frame));
+       pend += sizeof(frame);
+     }
      fb_.sputn((char*)cm.cbuf.get(), cm.csize);
-     dict_.push_back({pend, cm.csize, cm.un, cm.usize});
+     dict_.push_back({pend, cm.csize, cm.un, cm.usize, cm.codec_id, cm.filters, cm.typesize, 0});
+     if (fb_.pubsync() != 0) throw std::runtime_error("oarch: write failed");
    }
 
 
@@ -130,8 +469,7 @@ namespace archive {
      // read magic number for endianess test
      int32_t magic = 0;
      fb_.sgetn((char*)&magic, 4);
-     if (magic == 0x41484948) throw std::runtime_error("oarch: invalid endianness");
-     if (magic != 0x49484148) throw std::runtime_error("oarch: corrupt archive");
+     check_magic(magic);
 
      // read dictionary offset
      uint64_t pdict(0);
@@ -142,18 +480,70 @@ namespace archive {
      header_.resize(header_size);
      fb_.sgetn((char*)header_.data(), header_size);
 
-     // read dictionary
+     framed_ = (magic == magic_v3);
+     closed_ = false;
+     scan_pos_ = 13 + static_cast<uint64_t>(header_size);
+     dict_.clear();
+     last_.clear();
+     last_idx_ = size_t(-1);
+     if (pdict != 0) {
+       read_dict(pdict, magic == magic_v1);
+     }
+     else if (!framed_) {
+       throw std::runtime_error("oarch: archive wasn't closed");
+     }
+     else {
+       refresh();
+     }
+   }
+
+
+   void iarch::read_dict(uint64_t pdict, bool v1)
+   {
      fb_.pubseekoff(pdict, std::ios_base::beg);
-     uint32_t dsize = static_cast<uint32_t>(dict_.size());
+     uint32_t dsize = 0;
      fb_.sgetn((char*)&dsize, 4);
-     dict_.resize(dsize, {0,0,0,0});
-     fb_.sgetn((char*)dict_.data(), dsize * sizeof(dict));
+     dict_.clear();
+     if (v1) {
+       std::vector<dict_v1> d1(dsize);
+       fb_.sgetn((char*)d1.data(), dsize * sizeof(dict_v1));
+       for (const auto& d : d1) {
+         dict_.push_back(upgrade(d));
+       }
+     }
+     else {
+       dict_.resize(dsize);
+       fb_.sgetn((char*)dict_.data(), dsize * sizeof(dict));
+     }
+     closed_ = true;
+   }
+
+
+   size_t iarch::refresh()
+   {
+     if (closed_ || !fb_.is_open()) return dict_.size();
+     // closed in the meantime?
+     uint64_t pdict = 0;
+     fb_.pubseekoff(4, std::ios_base::beg);
+     fb_.sgetn((char*)&pdict, 8);
+     if (pdict != 0) {
+       read_dict(pdict, false);
+       return dict_.size();
+     }
+     const uint64_t end = fb_.pubseekoff(0, std::ios_base::end);
+     scan_pos_ = scan_frames([&](uint64_t pos, void* dst, size_t bytes) {
+       fb_.pubseekoff(pos, std::ios_base::beg);
+       fb_.sgetn((char*)dst, bytes);
+     }, scan_pos_, end, dict_);
+     return dict_.size();
    }
 
 
    void iarch::close()
    {
      dict_.clear();
+     last_.clear();
+     last_idx_ = size_t(-1);
      fb_.close();
    }
 
@@ -162,11 +552,418 @@ namespace archive {
    {
      if (idx >= dict_.size()) throw std::runtime_error("oarchive: invalid index");
      const auto& dict = dict_[idx];
-     fb_.pubseekoff(dict.ppos, std::ios_base::beg);
+     frame f;
+     if (framed_) {
+       fb_.pubseekoff(dict.ppos - sizeof(frame), std::ios_base::beg);
+       fb_.sgetn((char*)&f, sizeof(frame));
+     }
+     else {
+       fb_.pubseekoff(dict.ppos, std::ios_base::beg);
+     }
+     auto cbuf = compressed_mem::buffer((unsigned char*)std::malloc(std::max<size_t>(1, dict.csize)), std::free);
+     if (static_cast<uint32_t>(fb_.sgetn((char*)cbuf.get(), dict.csize)) != dict.csize) throw std::runtime_error("oarch: truncated archive");
+     if (framed_) check_frame(f, dict, cbuf.get());
+     return {dict.un, dict.usize, dict.csize, std::move(cbuf), dict.codec_id, dict.filters, dict.typesize};
+   }
+
 
-     auto cbuf = compressed_mem::buffer((unsigned char*)std::malloc(dict.csize), std::free);
-     fb_.sgetn((char*)cbuf.get(), dict.csize);
-     return {dict.un, dict.usize, dict.csize, std::move(cbuf)};
+   void iarch::decode(size_t idx, void* dst, size_t stride)
+   {
+     if (idx >= dict_.size()) throw std::runtime_error("oarchive: invalid index");
+     if (last_idx_ != idx) {
+       // back to the keyframe or the cached blob
+       size_t first = idx;
+       while ((dict_[first].filters & xor_delta) && last_idx_ + 1 != first) {
+         if (first == 0) throw std::runtime_error("oarchive: xor_delta without keyframe");
+         --first;
+       }
+       std::vector<unsigned char> cur;
+       for (size_t i = first; i <= idx; ++i) {
+         const auto cm = extract(i);
+         cur.resize(size_t(cm.un) * cm.usize);
+         if ((cm.filters & xor_delta) && last_.size() != cur.size()) throw std::runtime_error("oarchive: xor_delta size mismatch");
+         uncompress(cur.data(), cm, 0, last_.data());
+         last_.swap(cur);
+         last_idx_ = i;
+       }
+     }
+     const auto& d = dict_[idx];
+     if (stride == 0 || d.usize == stride) {
+       std::memcpy(dst, last_.data(), last_.size());
+     }
+     else {
+       for (size_t i = 0; i < d.un; ++i) {
+         std::memcpy((char*)dst + i * stride, last_.data() + i * d.usize, d.usize);
+       }
+     }
+   }
+
+
+   mapped_file::mapped_file(const fs::path& file, bool sequential)
+   {
+#if defined(_WIN32)
+     HANDLE hfile = ::CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, nullptr);
+     if (hfile == INVALID_HANDLE_VALUE) throw std::runtime_error("can't open " + file.string());
+     hfile_ = hfile;
+     LARGE_INTEGER size;
+     ::GetFileSizeEx(hfile, &size);
+     size_ = static_cast<size_t>(size.QuadPart);
+     hmap_ = size_ ? ::CreateFileMappingW(hfile, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+     data_ = hmap_ ? (const char*)::MapViewOfFile(hmap_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+     fd_ = ::open(file.c_str(), O_RDONLY);
+     if (fd_ < 0) throw std::runtime_error("can't open " + file.string());
+     struct stat st;
+     ::fstat(fd_, &st);
+     size_ = static_cast<size_t>(st.st_size);
+     if (size_) {
+       void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+       data_ = (p == MAP_FAILED) ? nullptr : (const char*)p;
+       if (data_ && sequential) ::madvise(p, size_, MADV_SEQUENTIAL);
+     }
+#endif
+     if (data_ == nullptr) {
+       release();
+       throw std::runtime_error("can't map " + file.string());
+     }
+   }
+
+
+   mapped_file::~mapped_file()
+   {
+     release();
+   }
+
+
+   void mapped_file::release()
+   {
+#if defined(_WIN32)
+     if (data_) ::UnmapViewOfFile(data_);
+     if (hmap_) ::CloseHandle(hmap_);
+     if (hfile_) ::CloseHandle(hfile_);
+     hmap_ = nullptr;
+     hfile_ = nullptr;
+#else
+     if (data_) ::munmap((void*)data_, size_);
+     if (fd_ >= 0) ::close(fd_);
+     fd_ = -1;
+#endif
+     data_ = nullptr;
+   }
+
+
+   mapped_iarch::mapped_iarch(const fs::path& file) : mf_(file)
+   {
+     const char* p = mf_.data();
+     const size_t fsize = mf_.size();
+     if (fsize < 13) throw std::runtime_error("oarch: corrupt archive");
+     int32_t magic = 0;
+     std::memcpy(&magic, p, 4);
+     check_magic(magic);
+     uint64_t pdict = 0;
+     std::memcpy(&pdict, p + 4, 8);
+     const size_t header_size = static_cast<unsigned char>(p[12]);
+     if (13 + header_size > fsize) throw std::runtime_error("oarch: corrupt archive");
+     header_.assign(p + 13, header_size);
+     framed_ = (magic == magic_v3);
+     if (pdict == 0) {
+       if (!framed_) throw std::runtime_error("oarch: archive wasn't closed");
+       scan_frames([&](uint64_t pos, void* dst, size_t bytes) { std::memcpy(dst, p + pos, bytes); }, 13 + header_size, fsize, dict_);
+       return;
+     }
+     if (pdict + 4 > fsize) throw std::runtime_error("oarch: corrupt archive");
+     uint32_t dsize = 0;
+     std::memcpy(&dsize, p + pdict, 4);
+     const size_t esize = (magic == magic_v1) ? sizeof(dict_v1) : sizeof(dict);
+     if (pdict + 4 + size_t(dsize) * esize > fsize) throw std::runtime_error("oarch: corrupt archive");
+     dict_.resize(dsize);
+     for (size_t i = 0; i < dsize; ++i) {
+       const char* e = p + pdict + 4 + i * esize;
+       if (magic == magic_v1) {
+         dict_v1 d;
+         std::memcpy(&d, e, sizeof(d));
+         dict_[i] = upgrade(d);
+       }
+       else {
+         std::memcpy(&dict_[i], e, sizeof(dict));
+       }
+       if (dict_[i].ppos + dict_[i].csize > pdict) throw std::runtime_error("oarch: corrupt archive");
+     }
+   }
+
+
+   compressed_view mapped_iarch::view(size_t idx) const
+   {
+     if (idx >= dict_.size()) throw std::runtime_error("oarchive: invalid index");
+     const auto& d = dict_[idx];
+     const unsigned char* cbuf = (const unsigned char*)mf_.data() + d.ppos;
+     if (framed_) {
+       frame f;
+       std::memcpy(&f, cbuf - sizeof(frame), sizeof(frame));
+       check_frame(f, d, cbuf);
+     }
+     return { d.un, d.usize, d.csize, cbuf, d.codec_id, d.filters, d.typesize };
+   }
+
+
+   size_t mapped_iarch::keyframe(size_t idx) const
+   {
+     while (dict_[idx].filters & xor_delta) {
+       if (idx == 0) throw std::runtime_error("oarchive: xor_delta without keyframe");
+       --idx;
+     }
+     return idx;
+   }
+
+
+   void mapped_iarch::decode(size_t idx, void* dst, size_t stride) const
+   {
+     if (idx >= dict_.size()) throw std::runtime_error("oarchive: invalid index");
+     decode_chain(keyframe(idx), &idx, &dst, 1, stride);
+   }
+
+
+   void mapped_iarch::decode_chain(size_t first, const size_t* idx, void* const* dst, size_t n, size_t stride) const
+   {
+     if (first == idx[n - 1]) {
+       uncompress(dst[n - 1], view(first), stride);
+       return;
+     }
+     std::vector<unsigned char> last, cur;
+     size_t j = 0;
+     for (size_t i = first; i <= idx[n - 1]; ++i) {
+       const auto cv = view(i);
+       cur.resize(size_t(cv.un) * cv.usize);
+       if ((cv.filters & xor_delta) && last.size() != cur.size()) throw std::runtime_error("oarchive: xor_delta size mismatch");
+       uncompress(cur.data(), cv, 0, last.data());
+       last.swap(cur);
+       if (i == idx[j]) {
+         if (stride == 0 || cv.usize == stride) {
+           if (!last.empty()) std::memcpy(dst[j], last.data(), last.size());
+         }
+         else {
+           for (size_t k = 0; k < cv.un; ++k) {
+             std::memcpy((char*)dst[j] + k * stride, last.data() + k * cv.usize, cv.usize);
+           }
+         }
+         ++j;
+       }
+     }
+   }
+
+
+   void mapped_iarch::extract_range(size_t g0, size_t g1, size_t stride, void* const* dst, int threads) const
+   {
+     if (stride == 0) throw std::runtime_error("extract_range: stride shall be > 0");
+     if (g1 > dict_.size()) throw std::runtime_error("oarchive: invalid index");
+     std::vector<size_t> idx;
+     for (size_t g = g0; g < g1; g += stride) idx.push_back(g);
+     extract_list(idx, dst, threads);
+   }
+
+
+   void mapped_iarch::extract_list(const std::vector<size_t>& idx, void* const* dst, int threads) const
+   {
+     if (idx.empty()) return;
+     for (auto i : idx) {
+       if (i >= dict_.size()) throw std::runtime_error("oarchive: invalid index");
+     }
+
+     // tasks: ascending runs of blobs sharing their keyframe
+     struct task { size_t first, j0, j1; };
+     std::vector<task> tasks;
+     for (size_t j = 0; j < idx.size(); ++j) {
+       const size_t kf = keyframe(idx[j]);
+       if (tasks.empty() || tasks.back().first != kf || idx[j] <= idx[j - 1]) {
+         tasks.push_back({ kf, j, j + 1 });
+       }
+       else {
+         tasks.back().j1 = j + 1;
+       }
+     }
+
+     if (threads <= 0) threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+     threads = std::min(threads, static_cast<int>(tasks.size()));
+     std::atomic<size_t> next{ 0 };
+     std::exception_ptr error;
+     std::mutex mutex;
+     auto work = [&]() {
+       for (size_t t = next++; t < tasks.size(); t = next++) {
+         const auto& tk = tasks[t];
+         try {
+           decode_chain(tk.first, idx.data() + tk.j0, dst + tk.j0, tk.j1 - tk.j0, 0);
+         }
+         catch (...) {
+           std::lock_guard<std::mutex> lock(mutex);
+           if (!error) error = std::current_exception();
+           next = tasks.size();
+         }
+       }
+     };
+     std::vector<std::thread> workers;
+     for (int i = 1; i < threads; ++i) {
+       workers.emplace_back(work);
+     }
+     work();
+     for (auto& worker : workers) worker.join();
+     if (error) std::rethrow_exception(error);
+   }
+
+
+   async_writer::async_writer(int threads, size_t max_pending)
+     : max_pending_(std::max<size_t>(1, max_pending))
+   {
+     for (int i = 0; i < threads; ++i) {
+       workers_.emplace_back(&async_writer::work, this);
+     }
+   }
+
+
+   async_writer::~async_writer()
+   {
+     try { flush(); } catch (...) {}
+     {
+       std::lock_guard<std::mutex> lock(mutex_);
+       stop_ = true;
+     }
+     cv_.notify_all();
+     for (auto& worker : workers_) worker.join();
+   }
+
+
+   void async_writer::insert(oarch& oa, const void* source, size_t n, size_t size, size_t stride)
+   {
+     const codec_param& cp = oa.param();
+     if (workers_.empty() && cp.keyframe == 0) {
+       oa.insert(compress(source, n, size, stride, cp));
+       return;
+     }
+     std::unique_lock<std::mutex> lock(mutex_);
+     cv_.wait(lock, [&]() { return jobs_.size() < max_pending_ || error_; });
+     rethrow();
+     raw_t raw;
+     if (!pool_.empty()) {
+       raw = std::move(pool_.back());
+       pool_.pop_back();
+     }
+     lock.unlock();
+     // snapshot of the source
+     if (!raw) raw = std::make_shared<std::vector<unsigned char>>();
+     raw->resize(n * size);
+     stride = stride ? stride : size;
+     if (stride == size) {
+       if (n * size) std::memcpy(raw->data(), source, n * size);
+     }
+     else {
+       for (size_t i = 0; i < n; ++i) {
+         std::memcpy(raw->data() + i * size, (const char*)source + i * stride, size);
+       }
+     }
+     lock.lock();
+     raw_t prev;
+     if (cp.keyframe > 0) {
+       auto it = streams_.find(&oa);
+       if (it == streams_.end()) {
+         // no pending jobs of oa, size() is stable
+         it = streams_.emplace(&oa, stream{ nullptr, oa.size() }).first;
+       }
+       auto& s = it->second;
+       if (s.last && (s.count % cp.keyframe) != 0 && s.last->size() == raw->size()) {
+         prev = s.last;
+       }
+       raw_t last = std::move(s.last);
+       s.last = raw;
+       recycle(last);
+       ++s.count;
+     }
+     if (workers_.empty()) {
+       lock.unlock();
+       oa.insert(compress(raw->data(), n, size, 0, cp, prev ? prev->data() : nullptr));
+       lock.lock();
+       recycle(prev);
+       recycle(raw);
+       return;
+     }
+     jobs_.push_back({ &oa, std::move(raw), std::move(prev), n, size, nullptr, false });
+     lock.unlock();
+     cv_.notify_all();
+   }
+
+
+   void async_writer::flush()
+   {
+     std::unique_lock<std::mutex> lock(mutex_);
+     cv_.wait(lock, [&]() { return jobs_.empty() && !writing_; });   // commit() pops before it inserts
+     rethrow();
+   }
+
+
+   void async_writer::work()
+   {
+     std::unique_lock<std::mutex> lock(mutex_);
+     for (;;) {
+       cv_.wait(lock, [&]() { return stop_ || next_ < jobs_.size(); });
+       if (next_ >= jobs_.size()) return;   // stop_
+       job& j = jobs_[next_++];             // deque: stable reference
+       lock.unlock();
+       std::unique_ptr<compressed_mem> cm;
+       try {
+         cm.reset(new compressed_mem(compress(j.raw->data(), j.n, j.size, 0, j.oa->param(), j.prev ? j.prev->data() : nullptr)));
+       }
+       catch (...) {
+         lock.lock();
+         if (!error_) error_ = std::current_exception();
+         lock.unlock();
+       }
+       lock.lock();
+       j.cm = std::move(cm);
+       j.done = true;
+       commit(lock);
+     }
+   }
+
+
+   // inserts the compressed jobs at the front, in order
+   void async_writer::commit(std::unique_lock<std::mutex>& lock)
+   {
+     while (!writing_ && !jobs_.empty() && jobs_.front().done) {
+       writing_ = true;
+       job j = std::move(jobs_.front());
+       jobs_.pop_front();
+       --next_;
+       lock.unlock();
+       try {
+         if (j.cm) j.oa->insert(*j.cm);
+       }
+       catch (...) {
+         lock.lock();
+         if (!error_) error_ = std::current_exception();
+         lock.unlock();
+       }
+       lock.lock();
+       recycle(j.prev);
+       recycle(j.raw);
+       writing_ = false;
+       cv_.notify_all();
+     }
+   }
+
+
+   // returns unshared buffers to the pool, call with the lock held
+   void async_writer::recycle(raw_t& raw)
+   {
+     if (raw && raw.use_count() == 1) pool_.push_back(std::move(raw));
+     raw.reset();
+   }
+
+
+   void async_writer::rethrow()
+   {
+     if (error_) {
+       auto err = error_;
+       error_ = nullptr;
+       std::rethrow_exception(err);
+     }
    }
 
 }
@@ -1,11 +1,19 @@
 #ifndef ARCHIVE_HPP_INCLUDED
 #define ARCHIVE_HPP_INCLUDED
 
+#include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <map>
 #include <fstream>
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 
 namespace fs = std::filesystem;
@@ -14,6 +22,49 @@ namespace fs = std::filesystem;
 namespace archive {
 
 
+  // Codecs, stored per blob. Part of the format, don't reorder.
+  enum class codec : uint8_t {
+    deflate = 0,    // zlib, level 1..9; the only codec of version 1 archives
+    lz4,            // LZ4 block format, cinema/lz4
+    store,          // uncompressed, also the fallback for incompressible blobs
+  };
+
+
+  // Pre-filters, stored per blob as bit set. Part of the format.
+  enum filter : uint8_t {
+    no_filter = 0,
+    shuffle = 1,      // byte-shuffle of typesize byte elements
+    bitshuffle = 2,   // bit-shuffle of typesize byte elements
+    xor_delta = 4,    // xor against the previous blob of the archive
+  };
+
+
+  // Compression options
+  struct codec_param
+  {
+    codec id = codec::deflate;
+    int level = 6;                  // deflate level
+    uint8_t filters = no_filter;    // shuffle or bitshuffle
+    uint8_t typesize = 4;           // element size of the (bit)shuffle [byte]
+    int keyframe = 0;               // async_writer: xor_delta, full blob every keyframe blobs. 0: off
+  };
+
+
+  // Codec registry entry
+  struct codec_info
+  {
+    const char* name;
+    size_t (*bound)(size_t bytes);
+    // returns the compressed size, 0 if it doesn't fit into dst[cap]
+    size_t (*compress)(unsigned char* dst, size_t cap, const unsigned char* src, size_t bytes, int level);
+    // throws on corrupt data
+    void (*uncompress)(unsigned char* dst, size_t bytes, const unsigned char* src, size_t csize);
+  };
+
+
+  const codec_info& get_codec(codec id);
+
+
   struct compressed_mem
   {
     using buffer = std::unique_ptr<unsigned char, decltype(std::free)*>;
@@ -22,27 +73,84 @@ namespace archive {
     const uint32_t usize;     // uncompressed blob-size [byte]
     const uint32_t csize;     // compressed buffer size
     buffer cbuf;              // compressed buffer
+    const codec codec_id = codec::deflate;
+    const uint8_t filters = no_filter;
+    const uint8_t typesize = 1;
   };
 
 
+  // prev: previous blob (n * size contiguous bytes), required for xor_delta
   compressed_mem compress(const void* source, 
                           const size_t n, 
                           const size_t size, 
-                          size_t stride = 0);
+                          size_t stride = 0,
+                          const codec_param& cp = {},
+                          const void* prev = nullptr);
+
+
+  // Non-owning compressed_mem
+  struct compressed_view
+  {
+    uint32_t un;
+    uint32_t usize;
+    uint32_t csize;
+    const unsigned char* cbuf;
+    codec codec_id;
+    uint8_t filters;
+    uint8_t typesize;
+  };
 
 
+  inline compressed_view view(const compressed_mem& cm)
+  {
+    return { cm.un, cm.usize, cm.csize, cm.cbuf.get(), cm.codec_id, cm.filters, cm.typesize };
+  }
+
+
+  // prev: previous uncompressed blob, required for xor_delta blobs
   void uncompress(void* dst, 
-                  const compressed_mem& src, 
-                  size_t stride = 0);
+                  const compressed_view& src, 
+                  size_t stride = 0,
+                  const void* prev = nullptr);
+
+
+  inline void uncompress(void* dst, 
+                         const compressed_mem& src, 
+                         size_t stride = 0,
+                         const void* prev = nullptr)
+  {
+    uncompress(dst, view(src), stride, prev);
+  }
 
 
 # pragma pack(push, 1)
   struct dict
   {
-    const uint64_t ppos;      // position in stream
-    const uint32_t csize;     // compressed size
-    const uint32_t un;        // number of blobs
-    const uint32_t usize;     // uncompressed blob-size [byte]
+    uint64_t ppos;      // position in stream
+    uint32_t csize;     // compressed size
+    uint32_t un;        // number of blobs
+    uint32_t usize;     // uncompressed blob-size [byte]
+    codec codec_id;     // version 2
+    uint8_t filters;
+    uint8_t typesize;
+    uint8_t reserved;
+  };
+
+  // Version 3 archives precede every blob by a frame, the dictionary
+  // written by close() is an index only. A file that wasn't closed,
+  // e.g. after a crash, is read by scanning the frames up to the
+  // first incomplete one.
+  struct frame
+  {
+    uint32_t magic;     // 'BLOB'
+    uint32_t csize;     // compressed size
+    uint32_t un;        // number of blobs
+    uint32_t usize;     // uncompressed blob-size [byte]
+    codec codec_id;
+    uint8_t filters;
+    uint8_t typesize;
+    uint8_t reserved;
+    uint32_t crc;       // crc32 of the compressed bytes
   };
 # pragma pack(pop)
 
@@ -51,22 +159,101 @@ namespace archive {
   {
   public:
     oarch() {}
-    oarch(const fs::path& file, const std::string& header);
+    oarch(const fs::path& file, const std::string& header, const codec_param& cp = {});
     ~oarch();
 
-    void open(const fs::path& file, const std::string& header);
+    void open(const fs::path& file, const std::string& header, const codec_param& cp = {});
     void close();
 
+    // reopens an archive, keeps the first n blobs.
+    // Version 3 archives needn't be closed.
+    void append(const fs::path& file, const std::string& header, size_t n, const codec_param& cp = {});
+
+    // compression options of the blobs inserted by async_writer
+    const codec_param& param() const { return cp_; }
+
+    // number of blobs
+    size_t size() const { return dict_.size(); }
+
+    // writes the blob through, readers see complete blobs only
     void insert(const compressed_mem& cm);
 
   private:
     std::vector<dict> dict_;
+    codec_param cp_;
+    bool framed_ = true;      // false: appending to a version 1 or 2 archive
     std::filebuf fb_;
   };
 
 
+  // Compresses blobs on worker threads and inserts them into their oarch.
+  //
+  // insert() copies the source into a pooled buffer and returns. The blobs
+  // are compressed concurrently but inserted in the order of the insert()
+  // calls, thus the dictionaries are the same as with oarch::insert.
+  // At most max_pending blobs are in flight; insert() blocks beyond.
+  // threads = 0 compresses and inserts synchronously.
+  // The blobs are compressed with oarch::param(). With keyframe > 0, all
+  // blobs with index % keyframe != 0 are xor_delta, except the first one
+  // inserted into an oarch.
+  // Flush (or destroy) the writer before closing the oarchs it writes to.
+  class async_writer
+  {
+  public:
+    async_writer(int threads, size_t max_pending);
+    ~async_writer();
+
+    async_writer(const async_writer&) = delete;
+    async_writer& operator=(const async_writer&) = delete;
+
+    // see compress
+    void insert(oarch& oa, const void* source, size_t n, size_t size, size_t stride = 0);
+
+    // waits for all pending blobs, rethrows worker exceptions
+    void flush();
+
+  private:
+    using raw_t = std::shared_ptr<std::vector<unsigned char>>;
+
+    struct job
+    {
+      oarch* oa;
+      raw_t raw;                            // pooled, n * size bytes
+      raw_t prev;                           // xor_delta reference or nullptr
+      size_t n, size;
+      std::unique_ptr<compressed_mem> cm;   // nullptr until compressed
+      bool done;
+    };
+
+    struct stream
+    {
+      raw_t last;                           // last blob if keyframe > 0
+      size_t count = 0;                     // blobs in the oarch
+    };
+
+    void work();
+    void commit(std::unique_lock<std::mutex>& lock);
+    void rethrow();
+    void recycle(raw_t& raw);
+
+    const size_t max_pending_;
+    std::deque<job> jobs_;                  // pending in insert order
+    size_t next_ = 0;                       // next job to compress
+    bool writing_ = false;                  // one thread inserts at a time
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::map<const oarch*, stream> streams_;
+    std::vector<raw_t> pool_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::thread> workers_;
+  };
+
+
   class iarch
   {
+    friend class oarch;
+
   public:
     explicit iarch(const fs::path& file);
     ~iarch();
@@ -76,12 +263,93 @@ namespace archive {
 
     std::string header() const { return header_; }
     size_t size() const { return dict_.size(); }
+    const dict& entry(size_t idx) const { return dict_.at(idx); }
     compressed_mem extract(size_t idx);
 
+    // uncompresses blob idx into dst, see uncompress.
+    // Resolves xor_delta chains, cheap for consecutive idx.
+    void decode(size_t idx, void* dst, size_t stride = 0);
+
+    // picks up the blobs written since open, for archives that are
+    // still written to. Returns size().
+    size_t refresh();
+
   private:
+    void read_dict(uint64_t pdict, bool v1);
+
     std::vector<dict> dict_;
     std::string header_;
+    bool framed_ = false;
+    bool closed_ = false;                   // dictionary read
+    uint64_t scan_pos_ = 0;                 // end of the last complete frame
     std::filebuf fb_;
+    std::vector<unsigned char> last_;       // last decoded blob
+    size_t last_idx_ = size_t(-1);
+  };
+
+
+  // Read-only memory map of a whole file
+  class mapped_file
+  {
+  public:
+    // sequential: read-ahead hint
+    explicit mapped_file(const fs::path& file, bool sequential = false);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    void release();
+
+    void* hfile_ = nullptr;     // Windows file and mapping handles
+    void* hmap_ = nullptr;
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+  };
+
+
+  // Memory mapped iarch.
+  //
+  // The compressed blobs are views into the mapped file, no reads and no
+  // copies. All members are const and thread-safe. An archive that is
+  // still written to is read as of construction.
+  class mapped_iarch
+  {
+  public:
+    explicit mapped_iarch(const fs::path& file);
+
+    std::string header() const { return header_; }
+    size_t size() const { return dict_.size(); }
+    const dict& entry(size_t idx) const { return dict_.at(idx); }
+
+    // compressed blob idx, valid during the lifetime of *this
+    compressed_view view(size_t idx) const;
+
+    // uncompresses blob idx into dst, see iarch::decode.
+    void decode(size_t idx, void* dst, size_t stride = 0) const;
+
+    // uncompresses the blobs g0, g0 + stride, ... < g1 into dst[0], dst[1], ...
+    // on threads threads, 0: hardware concurrency.
+    // Each dst[k] shall hold entry(g0 + k * stride).un * usize bytes.
+    void extract_range(size_t g0, size_t g1, size_t stride, void* const* dst, int threads = 0) const;
+
+    // uncompresses the blobs idx[0], idx[1], ... into dst[0], dst[1], ..., see extract_range.
+    void extract_list(const std::vector<size_t>& idx, void* const* dst, int threads = 0) const;
+
+  private:
+    // decodes first (not xor_delta) ... idx[n - 1], idx[j] into dst[j]
+    void decode_chain(size_t first, const size_t* idx, void* const* dst, size_t n, size_t stride) const;
+    size_t keyframe(size_t idx) const;
+
+    mapped_file mf_;
+    std::vector<dict> dict_;
+    std::string header_;
+    bool framed_ = false;
   };
 
 }
@@ -0,0 +1,251 @@
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+#include "checkpoint.h"
+#include "simulation.h"
+#include "archive.hpp"
+
+
+namespace filesystem = std::filesystem;
+
+
+namespace cine2 {
+
+
+  namespace {
+
+    const char magic[8] = { 'C', 'I', 'N', 'E', 'C', 'K', 'P', 'T' };
+
+    volatile std::sig_atomic_t sigterm_raised = 0;
+
+    extern "C" void on_sigterm(int)
+    {
+      sigterm_raised = 1;
+    }
+
+
+    using archive::mapped_file;
+
+
+    const checkpoint::header& checked_header(const mapped_file& mf)
+    {
+      if (mf.size() < sizeof(checkpoint::header)) throw std::runtime_error("checkpoint: not a checkpoint file");
+      const auto& hdr = *reinterpret_cast<const checkpoint::header*>(mf.data());
+      if (std::memcmp(hdr.magic, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("checkpoint: not a checkpoint file");
+      }
+      if (hdr.version != checkpoint::version) throw std::runtime_error("checkpoint: version mismatch");
+      if (sizeof(checkpoint::header) + hdr.sections * sizeof(checkpoint::section_entry) > mf.size()) {
+        throw std::runtime_error("checkpoint: truncated file");
+      }
+      return hdr;
+    }
+
+
+    // section table of a checkpoint to be written
+    class section_writer
+    {
+    public:
+      void add(checkpoint::section id, const void* src, size_t size)
+      {
+        entries_.push_back({ static_cast<uint32_t>(id), 0, 0, size });
+        src_.push_back(src);
+      }
+
+      void write(std::ostream& os, const checkpoint::header& hdr)
+      {
+        uint64_t ofs = sizeof(hdr) + entries_.size() * sizeof(checkpoint::section_entry);
+        for (auto& entry : entries_) {
+          ofs = (ofs + checkpoint::page_size - 1) & ~uint64_t(checkpoint::page_size - 1);
+          entry.offset = ofs;
+          ofs += entry.size;
+        }
+        os.write((const char*)&hdr, sizeof(hdr));
+        os.write((const char*)entries_.data(), entries_.size() * sizeof(checkpoint::section_entry));
+        uint64_t pos = sizeof(hdr) + entries_.size() * sizeof(checkpoint::section_entry);
+        const char zeros[checkpoint::page_size] = {};
+        for (size_t i = 0; i < entries_.size(); ++i) {
+          os.write(zeros, static_cast<std::streamsize>(entries_[i].offset - pos));
+          os.write((const char*)src_[i], static_cast<std::streamsize>(entries_[i].size));
+          pos = entries_[i].offset + entries_[i].size;
+        }
+      }
+
+      size_t sections() const { return entries_.size(); }
+
+    private:
+      std::vector<checkpoint::section_entry> entries_;
+      std::vector<const void*> src_;
+    };
+
+
+    // section table of a mapped checkpoint
+    class section_reader
+    {
+    public:
+      explicit section_reader(const mapped_file& mf) : mf_(mf)
+      {
+        const auto& hdr = checked_header(mf);
+        const auto* entry = reinterpret_cast<const checkpoint::section_entry*>(mf.data() + sizeof(hdr));
+        entries_.assign(entry, entry + hdr.sections);
+        for (const auto& e : entries_) {
+          if (e.offset + e.size > mf.size()) throw std::runtime_error("checkpoint: truncated file");
+        }
+      }
+
+      // copies section id into dst[size]
+      void copy(checkpoint::section id, void* dst, size_t size) const
+      {
+        const auto& e = find(id);
+        if (e.size != size) throw std::runtime_error("checkpoint: section size mismatch");
+        std::memcpy(dst, mf_.data() + e.offset, size);
+      }
+
+      // returns section id as vector
+      template <typename T>
+      std::vector<T> vector(checkpoint::section id) const
+      {
+        static_assert(std::is_trivially_copyable<T>::value, "can't restore T");
+        const auto& e = find(id);
+        if (e.size % sizeof(T)) throw std::runtime_error("checkpoint: section size mismatch");
+        const T* first = reinterpret_cast<const T*>(mf_.data() + e.offset);
+        return std::vector<T>(first, first + e.size / sizeof(T));
+      }
+
+    private:
+      const checkpoint::section_entry& find(checkpoint::section id) const
+      {
+        for (const auto& e : entries_) {
+          if (e.id == static_cast<uint32_t>(id)) return e;
+        }
+        throw std::runtime_error("checkpoint: missing section");
+      }
+
+      const mapped_file& mf_;
+      std::vector<checkpoint::section_entry> entries_;
+    };
+
+  }
+
+
+  uint64_t checkpoint_seed(const std::string& file)
+  {
+    mapped_file mf(file, true);
+    return checked_header(mf).seed;
+  }
+
+
+  SigtermGuard::SigtermGuard()
+  {
+    sigterm_raised = 0;
+    prev_ = std::signal(SIGTERM, on_sigterm);
+  }
+
+
+  SigtermGuard::~SigtermGuard()
+  {
+    std::signal(SIGTERM, (prev_ == SIG_ERR) ? SIG_DFL : prev_);
+  }
+
+
+  bool SigtermGuard::raised() const
+  {
+    return sigterm_raised != 0;
+  }
+
+
+  void Simulation::save_checkpoint(const std::string& file, int g, int t) const
+  {
+    using checkpoint::section;
+    const auto& pop = agents_.pop;
+    const auto& ann = *agents_.ann;
+    const auto& summary = analysis_.agents_summary();
+    const auto& input = analysis_.agents_input();
+
+    checkpoint::header hdr{};
+    std::memcpy(hdr.magic, magic, sizeof(magic));
+    hdr.version = checkpoint::version;
+    hdr.seed = param_.seed;
+    hdr.generation = g;
+    hdr.timestep = t;
+    hdr.conflicts = agents_.conflicts;
+    hdr.N = pop.size();
+    hdr.dim = landscape_.dim();
+    hdr.tile_shift = landscape_.tile_shift();
+    hdr.ann_size = ann.type_size();
+    hdr.regrowth = static_cast<int32_t>(param_.landscape.regrowth);
+    hdr.regrowth_now = regrowth_.now();
+    param_.agents.ann.copy(hdr.ann, sizeof(hdr.ann) - 1);
+
+    section_writer sw;
+    sw.add(section::individuals, pop.data(), pop.mem_size());
+    sw.add(section::anns, ann.data(), size_t(ann.N()) * ann.type_size());
+    sw.add(section::tmp_individuals, agents_.tmp_pop.data(), agents_.tmp_pop.mem_size());
+    sw.add(section::tmp_anns, agents_.tmp_ann->data(), size_t(ann.N()) * ann.type_size());
+    sw.add(section::fitness, agents_.fitness.data(), agents_.fitness.size() * sizeof(float));
+    sw.add(section::foraged, agents_.foraged.data(), agents_.foraged.size() * sizeof(float));
+    sw.add(section::handled, agents_.handled.data(), agents_.handled.size() * sizeof(float));
+    sw.add(section::landscape, landscape_.data(), landscape_.mem_size());
+    sw.add(section::regrowth_due, regrowth_.due().data(), regrowth_.due().size() * sizeof(uint64_t));
+    sw.add(section::summary, summary.data(), summary.size() * sizeof(Analysis::Summary));
+    sw.add(section::input0, input[0].data(), input[0].size() * sizeof(Analysis::Input));
+    sw.add(section::input1, input[1].data(), input[1].size() * sizeof(Analysis::Input));
+    sw.add(section::input2, input[2].data(), input[2].size() * sizeof(Analysis::Input));
+    hdr.sections = static_cast<uint32_t>(sw.sections());
+
+    // write aside, replace the former checkpoint when complete
+    const auto tmp = filesystem::path(file + ".tmp");
+    {
+      std::ofstream os(tmp, std::ios::out | std::ios::binary);
+      if (!os) throw std::runtime_error("can't create checkpoint " + tmp.string());
+      sw.write(os, hdr);
+      os.flush();
+      if (!os) throw std::runtime_error("can't write checkpoint " + tmp.string());
+    }
+    filesystem::rename(tmp, file);
+  }
+
+
+  void Simulation::restore_checkpoint(const std::string& file)
+  {
+    using checkpoint::section;
+    mapped_file mf(file, true);
+    const auto& hdr = checked_header(mf);
+    auto& pop = agents_.pop;
+    auto& ann = *agents_.ann;
+    if (hdr.seed != param_.seed) throw cmd::parse_error("checkpoint: seed mismatch");
+    if (hdr.N != pop.size()) throw cmd::parse_error("checkpoint: agents.N mismatch");
+    if (hdr.ann_size != ann.type_size() || param_.agents.ann != std::string(hdr.ann, strnlen(hdr.ann, sizeof(hdr.ann)))) {
+      throw cmd::parse_error("checkpoint: agents.ann mismatch");
+    }
+    if (hdr.dim != landscape_.dim()) throw cmd::parse_error("checkpoint: landscape dimension mismatch");
+    if (hdr.tile_shift != landscape_.tile_shift()) throw cmd::parse_error("checkpoint: landscape.layout mismatch");
+    if (hdr.regrowth != static_cast<int32_t>(param_.landscape.regrowth)) throw cmd::parse_error("checkpoint: landscape.regrowth mismatch");
+    if (hdr.generation > param_.G) throw cmd::parse_error("checkpoint: beyond G");
+
+    const section_reader sr(mf);
+    sr.copy(section::individuals, pop.data(), pop.mem_size());
+    sr.copy(section::anns, ann.data(), size_t(ann.N()) * ann.type_size());
+    sr.copy(section::tmp_individuals, agents_.tmp_pop.data(), agents_.tmp_pop.mem_size());
+    sr.copy(section::tmp_anns, agents_.tmp_ann->data(), size_t(ann.N()) * ann.type_size());
+    sr.copy(section::fitness, agents_.fitness.data(), agents_.fitness.size() * sizeof(float));
+    sr.copy(section::foraged, agents_.foraged.data(), agents_.foraged.size() * sizeof(float));
+    sr.copy(section::handled, agents_.handled.data(), agents_.handled.size() * sizeof(float));
+    sr.copy(section::landscape, landscape_.data(), landscape_.mem_size());
+    agents_.conflicts = hdr.conflicts;
+    if (param_.landscape.regrowth == Regrowth::wheel) {
+      const auto due = sr.vector<uint64_t>(section::regrowth_due);
+      if (due.size() != size_t(hdr.dim) * hdr.dim) throw std::runtime_error("checkpoint: section size mismatch");
+      regrowth_.restore(param_.landscape.item_growth, hdr.regrowth_now, due.data(), due.size());
+    }
+    analysis_.restore(sr.vector<Analysis::Summary>(section::summary),
+                      { sr.vector<Analysis::Input>(section::input0),
+                        sr.vector<Analysis::Input>(section::input1),
+                        sr.vector<Analysis::Input>(section::input2) });
+    g0_ = hdr.generation;
+    t0_ = hdr.timestep;
+  }
+
+}
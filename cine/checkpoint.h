@@ -0,0 +1,99 @@
+#ifndef CINE2_CHECKPOINT_H_INCLUDED
+#define CINE2_CHECKPOINT_H_INCLUDED
+
+#include <cstdint>
+#include <csignal>
+#include <string>
+
+
+namespace cine2 {
+
+
+  /// \brief  Binary checkpoint of a Simulation.
+  ///
+  /// Layout: checkpoint_header, checkpoint_section[sections], followed
+  /// by the raw sections, each starting at a page boundary (4096 bytes).
+  /// The sections are the in-memory images of the state, native byte
+  /// order. Restoring maps the file and copies the sections in place.
+  namespace checkpoint {
+
+    constexpr uint32_t version = 1;
+    constexpr size_t page_size = 4096;
+
+    /// \brief  Section ids, part of the format, don't reorder.
+    enum class section : uint32_t {
+      individuals,      // Individuals::data()
+      anns,             // any_ann::data()
+      tmp_individuals,  // Population::tmp_pop, the ancestors
+      tmp_anns,         // Population::tmp_ann, the ancestors Anns
+      fitness,          // float[N]
+      foraged,          // float[N]
+      handled,          // float[N]
+      landscape,        // Landscape::data()
+      regrowth_due,     // uint64_t[dim * dim], empty for Regrowth::sweep
+      summary,          // Analysis::Summary[generations]
+      input0,           // Analysis::Input[generations]
+      input1,
+      input2,
+      max_section
+    };
+
+#   pragma pack(push, 1)
+    struct header
+    {
+      char magic[8];          // "CINECKPT"
+      uint32_t version;
+      uint32_t sections;      // entries in the section table
+      uint64_t seed;          // key of the random streams
+      int32_t generation;     // resume point: first timestep to simulate
+      int32_t timestep;
+      int32_t conflicts;      // Population::conflicts
+      int32_t N;              // fingerprint of the run
+      int32_t dim;
+      int32_t tile_shift;
+      int32_t ann_size;
+      int32_t regrowth;
+      uint64_t regrowth_now;  // ItemRegrowth clock
+      char ann[32];           // ann name, zero terminated
+    };
+
+    struct section_entry
+    {
+      uint32_t id;
+      uint32_t reserved;
+      uint64_t offset;        // from the begin of the file, page aligned
+      uint64_t size;          // [bytes]
+    };
+#   pragma pack(pop)
+
+  }
+
+
+  /// \return the seed stored in the checkpoint file.
+  ///
+  /// \exception  std::runtime_error  Raised if file is not a checkpoint.
+  uint64_t checkpoint_seed(const std::string& file);
+
+
+  /// \brief  Catches SIGTERM during its lifetime.
+  ///
+  /// The handler only sets a flag; the simulation polls raised() at
+  /// timestep boundaries, writes a checkpoint and stops.
+  class SigtermGuard
+  {
+  public:
+    SigtermGuard();
+    ~SigtermGuard();
+
+    SigtermGuard(const SigtermGuard&) = delete;
+    SigtermGuard& operator=(const SigtermGuard&) = delete;
+
+    bool raised() const;
+
+  private:
+    void (*prev_)(int);
+  };
+
+}
+
+#endif
@@ -28,7 +28,7 @@ import.raw <- function(filename, type, size) {
 # auxiliary function
 import.generation <- function(G, what, stderr) {
   if (!(what=="pred" || what=="agents")) stop("argument what shall be 'agents' or 'pred'")
-  extractor <- paste0(config$dir, '/depends/extract.exe')
+  extractor <- paste0(config$dir, '/depends/extract', ifelse(.Platform$OS.type == "windows", ".exe", ""))
   Args <- paste0('G="', toString(G), '" ' , "dir=", config$dir, " what=", what)
   system2(extractor, args=Args, stderr=stderr)
   ann <- matrix(import.raw(paste0(config$dir, "/tmp/", what, "_ann.tmp"), numeric(), 8),
@@ -49,6 +49,43 @@ generation <- function(G, stderr=F) {
   list(agents=agents)
 }
 
+# auxiliary function
+import.generations <- function(G, what, streams, float32, stderr) {
+  if (!(what=="pred" || what=="agents")) stop("argument what shall be 'agents' or 'pred'")
+  extractor <- paste0(config$dir, '/depends/extract', ifelse(.Platform$OS.type == "windows", ".exe", ""))
+  Args <- paste0('G="', paste(G, collapse=","), '" ', "dir=", config$dir, " what=", what,
+                 " streams=", paste(streams, collapse=","), ifelse(float32, " --float32", ""))
+  system2(extractor, args=Args, stderr=stderr)
+  res <- list(G=G)
+  for (s in streams) {
+    fname <- paste0(config$dir, "/tmp/", what, "_", s, ".tmp")
+    if (s == "anc") {
+      x <- import.raw(fname, integer(), 4)
+    } else {
+      x <- import.raw(fname, numeric(), ifelse(float32, 4, 8))
+    }
+    if (s == "ann") {
+      res[[s]] <- matrix(x, ncol=config[[paste0(what, ".ann.weights")]], byrow=T)
+    } else {
+      res[[s]] <- matrix(x, nrow=length(G), byrow=T)
+    }
+  }
+  system2(extractor, paste0("dir=", config$dir, " --cleanup"))
+  res
+}
+
+# extract generations, one run of the extractor
+# params:
+#   G       : vector of generations
+#   streams : subset of c("ann", "fit", "anc", "foa", "han")
+#   float32 : single precision transfer
+# fit, anc, foa, han: one row per generation
+# ann: one row per individual, generation after generation
+generations <- function(G, streams=c("ann", "fit", "anc", "foa", "han"), float32=F, stderr=F) {
+  agents = import.generations(G, "agents", streams, float32, stderr)
+  list(agents=agents)
+}
+
 # load input estimates
 input <- function() {
   agents = matrix(import.raw(paste0(config$dir, '/agents_input.bin'), numeric(), 8), ncol=15, byrow=T)
@@ -95,20 +132,43 @@ config$dir = getSrcDirectory(generation)[1]
       
       switch (msg) {
         case msg_type::INITIALIZED:
-          oa_agents_ann_.open(folder / "agents_ann.arc", sim->param().agents.ann);
-          oa_agents_fit_.open(folder / "agents_fit.arc", "fitness");
-          oa_agents_anc_.open(folder / "agents_anc.arc", "ancestors");
-          oa_agents_foa_.open(folder / "agents_foa.arc", "forage");
-          oa_agents_han_.open(folder / "agents_han.arc", "handle");
-
+        {
+          writer_.reset(new archive::async_writer(sim->param().archive.threads, sim->param().archive.pending));
+          auto cp = sim->param().archive.codec;
+          cp.typesize = 4;    // float, int
+          if (sim->param().resume.empty()) {
+            oa_agents_ann_.open(folder / "agents_ann.arc", sim->param().agents.ann, cp);
+            oa_agents_fit_.open(folder / "agents_fit.arc", "fitness", cp);
+            oa_agents_anc_.open(folder / "agents_anc.arc", "ancestors", cp);
+            oa_agents_foa_.open(folder / "agents_foa.arc", "forage", cp);
+            oa_agents_han_.open(folder / "agents_han.arc", "handle", cp);
+          }
+          else {
+            // continue the archives of the checkpointed run
+            const size_t G0 = sim->first_generation();
+            oa_agents_ann_.append(folder / "agents_ann.arc", sim->param().agents.ann, G0, cp);
+            oa_agents_fit_.append(folder / "agents_fit.arc", "fitness", G0, cp);
+            oa_agents_anc_.append(folder / "agents_anc.arc", "ancestors", G0, cp);
+            oa_agents_foa_.append(folder / "agents_foa.arc", "forage", G0, cp);
+            oa_agents_han_.append(folder / "agents_han.arc", "handle", G0, cp);
+          }
+          open_analysis();
+          stream_analysis(sim);
           break;
+        }
         case msg_type::GENERATION:
           stream_generation(sim->agents(), oa_agents_ann_, oa_agents_fit_, oa_agents_anc_, oa_agents_foa_, oa_agents_han_);
-
+          stream_analysis(sim);
+          break;
+        case msg_type::CHECKPOINT:
+          writer_->flush();   // the archives hold all generations of the checkpoint
           break;
         case msg_type::FINISHED:
+          writer_->flush();
           stream_meta(sim);
           stream_analysis(sim);
+          os_summary_.close();
+          os_input_.close();
           copy_dependencies();
           break;
       }
@@ -123,30 +183,31 @@ config$dir = getSrcDirectory(generation)[1]
                            archive::oarch& oa_foa,
                            archive::oarch& oa_han)
     {
-      oa_ann.insert(archive::compress(Pop.ann->data(),
-                                      Pop.ann->N(),
-                                      Pop.ann->state_size() * sizeof(float),
-                                      Pop.ann->stride() * sizeof(float)));
-      oa_fit.insert(archive::compress(Pop.fitness.data(),
-                                      Pop.fitness.size(),
-                                      sizeof(float)));
-      oa_anc.insert(archive::compress((char*)Pop.pop.data() + offsetof(Individual, ancestor),
-                                      Pop.pop.size(),
-                                      sizeof(int),
-                                      sizeof(Individual)));
-      oa_foa.insert(archive::compress(Pop.foraged.data(),
-                                      Pop.foraged.size(),
-                                      sizeof(float)));
-      oa_han.insert(archive::compress(Pop.handled.data(),
-                                      Pop.handled.size(),
-                                      sizeof(float)));
+      // snapshots, compressed and written while the next generation runs
+      writer_->insert(oa_ann, Pop.ann->data(),
+                              Pop.ann->N(),
+                              Pop.ann->state_size() * sizeof(float),
+                              Pop.ann->stride() * sizeof(float));
+      writer_->insert(oa_fit, Pop.fitness.data(),
+                              Pop.fitness.size(),
+                              sizeof(float));
+      writer_->insert(oa_anc, Pop.pop.ancestor(),
+                              Pop.pop.size(),
+                              sizeof(int));
+      writer_->insert(oa_foa, Pop.foraged.data(),
+                              Pop.foraged.size(),
+                              sizeof(float));
+      writer_->insert(oa_han, Pop.handled.data(),
+                              Pop.handled.size(),
+                              sizeof(float));
     }
 
 
-    void stream_summary(std::ostream& os, const int N, const std::vector<Analysis::Summary>& summary)
+    // rows g0, g0 + 1, ...
+    void stream_summary(std::ostream& os, const int N, const std::vector<Analysis::Summary>& summary, size_t g0)
     {
       const size_t g = summary.size();
-      for (size_t i = 0; i < g; ++i) {
+      for (size_t i = g0; i < g; ++i) {
         double val = summary[i].ave_fitness; os.write((const char*)&val, sizeof(double));
         val = (summary[i].ave_fitness * N)/ summary[i].repro_ind; os.write((const char*)&val, sizeof(double));
         val = summary[i].repro_ind; os.write((const char*)&val, sizeof(double));
@@ -160,10 +221,10 @@ config$dir = getSrcDirectory(generation)[1]
 
 
     template <typename INPUT>
-    void stream_input(std::ostream& os, const INPUT& input)
+    void stream_input(std::ostream& os, const INPUT& input, size_t g0)
     {
       const size_t g = input[0].size();
-      for (size_t i = 0; i < g; ++i) {
+      for (size_t i = g0; i < g; ++i) {
         for (int j = 0; j < 3; ++j) {
           double val = input[j][i].mini; os.write((const char*)&val, sizeof(double));
           val = input[j][i].maxi; os.write((const char*)&val, sizeof(double));
@@ -175,27 +236,29 @@ config$dir = getSrcDirectory(generation)[1]
     }
 
 
-    void stream_analysis(const Simulation* sim)
+    // the analysis files grow generation by generation and are
+    // readable while the simulation runs
+    void open_analysis()
     {
-      {
-        std::ofstream os;
-        os.open(folder / "agents_summary.bin", std::ios::out | std::ios::binary); 
-        if (!os.is_open()) throw std::runtime_error("can't create agents_summary.bin");
-        stream_summary(os, sim->param().agents.N, sim->analysis().agents_summary());
-      }
-      //{
-      //  std::ofstream os;
-      //  os.open(folder / "pred_summary.bin", std::ios::out | std::ios::binary); 
-      //  if (!os.is_open()) throw std::runtime_error("can't create pred_summary.bin");
-      //  stream_summary(os, sim->param().pred.N, sim->analysis().pred_summary());
-      //}
-      {
-        std::ofstream os;
-        os.open(folder / "agents_input.bin", std::ios::out | std::ios::binary); 
-        if (!os.is_open()) throw std::runtime_error("can't create agents_input.bin");
-        stream_input(os, sim->analysis().agents_input());
-      }
+      os_summary_.open(folder / "agents_summary.bin", std::ios::out | std::ios::binary);
+      if (!os_summary_.is_open()) throw std::runtime_error("can't create agents_summary.bin");
+      //os_pred_summary_.open(folder / "pred_summary.bin", std::ios::out | std::ios::binary);
+      os_input_.open(folder / "agents_input.bin", std::ios::out | std::ios::binary);
+      if (!os_input_.is_open()) throw std::runtime_error("can't create agents_input.bin");
+      rows_ = 0;
+    }
 
+
+    void stream_analysis(const Simulation* sim)
+    {
+      const auto& summary = sim->analysis().agents_summary();
+      stream_summary(os_summary_, sim->param().agents.N, summary, rows_);
+      //stream_summary(os_pred_summary_, sim->param().pred.N, sim->analysis().pred_summary(), rows_);
+      stream_input(os_input_, sim->analysis().agents_input(), rows_);
+      rows_ = summary.size();
+      os_summary_.flush();
+      os_input_.flush();
+      if (!os_summary_ || !os_input_) throw std::runtime_error("can't write analysis");
     }
 
 
@@ -219,11 +282,20 @@ config$dir = getSrcDirectory(generation)[1]
 
     void copy_dependencies()
     {
+#if defined(_WIN32)
+      const char* extractor = "extract.exe";
+#else
+      const char* extractor = "extract";
+#endif
       auto cur = fs::current_path();
       if (!fs::exists(folder / "depends")) {
         fs::create_directory(folder / "depends");
       }
-      fs::copy(cur / "extract.exe", folder / "depends", fs::copy_options::overwrite_existing);
+      if (!fs::exists(cur / extractor)) {
+        std::cerr << "\n" << extractor << " not found in working directory, " << (folder / "depends") << " left empty\n";
+        return;
+      }
+      fs::copy(cur / extractor, folder / "depends", fs::copy_options::overwrite_existing);
     }
 
 	  fs::path folder;
@@ -232,10 +304,81 @@ config$dir = getSrcDirectory(generation)[1]
     archive::oarch oa_agents_anc_;
     archive::oarch oa_agents_foa_;
     archive::oarch oa_agents_han_;
+    std::unique_ptr<archive::async_writer> writer_;   // destroyed, i.e. flushed, before the oarchs
+    std::ofstream os_summary_;
+    std::ofstream os_input_;
+    size_t rows_ = 0;   // analysis rows written
 
   };
 
 
+  // Per-timestep trace of a replayed generation, see Param::replay.
+  // One blob per timestep in each archive, after the timestep.
+  class TraceObserver : public Observer
+  {
+  public:
+    explicit TraceObserver(const fs::path& path)
+    : Observer(),
+      folder(path)
+    {
+    }
+
+    ~TraceObserver() override
+    {
+    }
+
+    // required observer interface
+    bool notify(void* userdata, long long msg) override
+    {
+      auto sim = reinterpret_cast<const Simulation*>(userdata);
+      using msg_type = Simulation::msg_type;
+
+      switch (msg) {
+        case msg_type::INITIALIZED:
+        {
+          writer_.reset(new archive::async_writer(sim->param().archive.threads, sim->param().archive.pending));
+          auto cp = sim->param().archive.codec;
+          cp.typesize = sizeof(short);
+          oa_pos_.open(folder / "trace_pos.arc", "position", cp);
+          cp.typesize = 1;
+          oa_flags_.open(folder / "trace_flags.arc", "flags", cp);
+          cp.typesize = 4;
+          oa_food_.open(folder / "trace_food.arc", "food", cp);
+          oa_con_.open(folder / "trace_con.arc", "conflicts", cp);
+          break;
+        }
+        case msg_type::POST_TIMESTEP: {
+          const auto& pop = sim->agents().pop;
+          const auto& conflicts = sim->conflicts();
+          writer_->insert(oa_pos_, pop.pos(), pop.size(), sizeof(Coordinate));
+          writer_->insert(oa_flags_, pop.flags(), pop.size(), sizeof(uint8_t));
+          writer_->insert(oa_food_, pop.food(), pop.size(), sizeof(float));
+          writer_->insert(oa_con_, conflicts.data(), conflicts.size(), 2 * sizeof(int));
+          break;
+        }
+        case msg_type::CHECKPOINT:
+          writer_->flush();
+          break;
+        case msg_type::FINISHED: {
+          writer_->flush();
+          std::ofstream os(folder / "config.ini");
+          stream_parameter(os, sim->param(), "", "\n", "{", "}");
+          break;
+        }
+      }
+      return notify_next(userdata, msg);
+    };
+
+  private:
+    fs::path folder;
+    archive::oarch oa_pos_;       // Coordinate[N]
+    archive::oarch oa_flags_;     // Individuals::Flags[N]
+    archive::oarch oa_food_;      // float[N]
+    archive::oarch oa_con_;       // {attacker, attacked}[conflicts]
+    std::unique_ptr<archive::async_writer> writer_;   // destroyed, i.e. flushed, before the oarchs
+  };
+
+
   std::unique_ptr<Observer> CreateCnObserver(const std::string& folder)
   {
     fs::path path(folder);
@@ -244,5 +387,12 @@ config$dir = getSrcDirectory(generation)[1]
   }
 
 
-}
+  std::unique_ptr<Observer> CreateTraceObserver(const std::string& folder)
+  {
+    fs::path path(folder);
+    fs::create_directory(path);
+    return std::unique_ptr<Observer>(new TraceObserver(path));
+  }
 
+
+}
@@ -9,6 +9,9 @@ namespace cine2 {
 
   std::unique_ptr<class Observer> CreateCnObserver(const std::string& folder);
 
+  // traces the replayed generation, see Param::replay
+  std::unique_ptr<class Observer> CreateTraceObserver(const std::string& folder);
+
 }
 
 
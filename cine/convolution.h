@@ -3,7 +3,9 @@
 
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <numeric>
+#include <vector>
 
 
 namespace cine2 {
@@ -15,7 +17,8 @@ namespace cine2 {
     static_assert(KernelSize & 1, "Kernel size shall be odd");
     static const int k = KernelSize;
     
-    static void normalize(std::array<float, KernelSize * KernelSize>& K)
+    template <size_t N>
+    static void normalize(std::array<float, N>& K)
     {
       auto sum = std::accumulate(K.cbegin(), K.cend(), 0.0f);
       for (auto& x : K) x /= sum;
@@ -23,17 +26,21 @@ namespace cine2 {
   };
 
 
+  // K = K1 x K1, K1 is the separable 1D factor
   template <int KernelSize>
   struct BoxFilter : ConvolutionKernel<KernelSize>
   {
     BoxFilter()
     {
-      K.assign(1.0);
+      K.fill(1.0f);
+      K1.fill(1.0f);
       ConvolutionKernel<KernelSize>::normalize(K);
+      ConvolutionKernel<KernelSize>::normalize(K1);
     }
 
     float maxK() const { return K[KernelSize / 2]; }
     std::array<float, KernelSize * KernelSize> K;
+    std::array<float, KernelSize> K1;
   };
 
 
@@ -52,14 +59,144 @@ namespace cine2 {
           K[s++] = std::exp(-0.5f * ((x * x) + (y * y)));
         }
       }
+      for (int x=-radius; x <= radius; ++x) {
+        K1[x + radius] = std::exp(-0.5f * (x * x));
+      }
       ConvolutionKernel<KernelSize>::normalize(K);
+      ConvolutionKernel<KernelSize>::normalize(K1);
     }
 
     float maxK() const { return K[KernelSize / 2]; }
     std::array<float, KernelSize * KernelSize> K;
+    std::array<float, KernelSize> K1;
   };
 
 
+  namespace detail {
+
+    // out[x] = sum_i K1[i] * in[x - i + r], in is a row on a torus
+    template <int KernelSize>
+    inline void convolve_row(float* __restrict out, const float* __restrict in, int dim, const std::array<float, KernelSize>& K1)
+    {
+      constexpr int r = KernelSize / 2;
+      const int mask = dim - 1;
+      for (int x = 0; x < r; ++x) {
+        float s = 0.f;
+        for (int i = 0; i < KernelSize; ++i) s += K1[i] * in[(x - i + r) & mask];
+        out[x] = s;
+      }
+#     pragma omp simd
+      for (int x = r; x < dim - r; ++x) {
+        float s = 0.f;
+        for (int i = 0; i < KernelSize; ++i) s += K1[i] * in[x - i + r];
+        out[x] = s;
+      }
+      for (int x = dim - r; x < dim; ++x) {
+        float s = 0.f;
+        for (int i = 0; i < KernelSize; ++i) s += K1[i] * in[(x - i + r) & mask];
+        out[x] = s;
+      }
+    }
+
+    // out[x] = sum_j K1[j] * rows[j][x]
+    template <int KernelSize>
+    inline void convolve_rows(float* __restrict out, const float* const* rows, int dim, const std::array<float, KernelSize>& K1)
+    {
+#     pragma omp simd
+      for (int x = 0; x < dim; ++x) {
+        float s = 0.f;
+        for (int j = 0; j < KernelSize; ++j) s += K1[j] * rows[j][x];
+        out[x] = s;
+      }
+    }
+
+  }
+
+
+  /// \brief  Separable convolution on a torus.
+  ///
+  /// dst(x,y) = sum_ij K1[i] * K1[j] * src(x - i + r, y - j + r), r = KernelSize / 2.
+  /// Gives the same result as stamping K = K1 x K1 around every unit in src.
+  ///
+  /// \param dst   Destination, dim x dim
+  /// \param src   Source, dim x dim, may alias dst
+  /// \param tmp   Scratch, dim x dim
+  /// \param dim   Dimension (POT)
+  /// \param K1    1D kernel
+  template <int KernelSize>
+  void convolve_separable(float* dst, const float* src, float* __restrict tmp, int dim, const std::array<float, KernelSize>& K1)
+  {
+    constexpr int r = KernelSize / 2;
+    const int mask = dim - 1;
+
+    // horizontal pass src -> tmp
+#   pragma omp parallel for schedule(static)
+    for (int y = 0; y < dim; ++y) {
+      detail::convolve_row<KernelSize>(tmp + y * dim, src + y * dim, dim, K1);
+    }
+
+    // vertical pass tmp -> dst
+#   pragma omp parallel for schedule(static)
+    for (int y = 0; y < dim; ++y) {
+      const float* rows[KernelSize];
+      for (int j = 0; j < KernelSize; ++j) rows[j] = tmp + ((y - j + r) & mask) * dim;
+      detail::convolve_rows<KernelSize>(dst + y * dim, rows, dim, K1);
+    }
+  }
+
+
+  /// \brief  Separable convolution on a torus of tiles.
+  ///
+  /// As above for layers stored in row-major tiles of 2^tile_shift x 2^tile_shift
+  /// cells (see cell_index). The rows are gathered from the tiles, tmp holds
+  /// the horizontal pass in row-major order. Same result as the row-major
+  /// convolution of the same layer.
+  ///
+  /// \param tile_shift  log2 of the tile size, log2(dim) for row-major layers
+  template <int KernelSize>
+  void convolve_separable(float* dst, const float* src, float* __restrict tmp, int dim, int tile_shift, const std::array<float, KernelSize>& K1)
+  {
+    if ((1 << tile_shift) >= dim) {
+      convolve_separable<KernelSize>(dst, src, tmp, dim, K1);
+      return;
+    }
+    constexpr int r = KernelSize / 2;
+    const int mask = dim - 1;
+    const int tile = 1 << tile_shift;
+    const int tile_mask = tile - 1;
+    // begin of row y in the tiles, successive tiles are tile * tile apart
+    auto row_begin = [=](int y) { return size_t(y >> tile_shift) * dim * tile + size_t(y & tile_mask) * tile; };
+
+#   pragma omp parallel
+    {
+      std::vector<float> buf(dim);
+      float* __restrict row = buf.data();
+
+      // horizontal pass src -> tmp (row-major)
+#     pragma omp for schedule(static)
+      for (int y = 0; y < dim; ++y) {
+        const float* in = src + row_begin(y);
+        for (int x = 0; x < dim; x += tile, in += tile * tile) {
+          std::memcpy(row + x, in, tile * sizeof(float));
+        }
+        detail::convolve_row<KernelSize>(tmp + size_t(y) * dim, row, dim, K1);
+      }
+
+      // vertical pass tmp -> dst
+#     pragma omp for schedule(static)
+      for (int y = 0; y < dim; ++y) {
+        const float* rows[KernelSize];
+        for (int j = 0; j < KernelSize; ++j) rows[j] = tmp + size_t((y - j + r) & mask) * dim;
+        detail::convolve_rows<KernelSize>(row, rows, dim, K1);
+        float* out = dst + row_begin(y);
+        for (int x = 0; x < dim; x += tile, out += tile * tile) {
+          std::memcpy(out, row + x, tile * sizeof(float));
+        }
+      }
+    }
+  }
+
+
 }
 
 #endif
@@ -5,6 +5,7 @@
 #define HISTOGRAM_HPP_INCLUDED
 
 #include <vector>
+#include <stdexcept>
 #include <numeric>
 #include <algorithm>
 #include <glm/glm.hpp>
@@ -151,7 +152,7 @@ inline void histogram::append(const histogram& h)
   bool compatible = (num_bins() == h.num_bins()) && (binsScale_ == h.binsScale_) && (binsOffs_ == h.binsOffs_);
   if (!compatible)
   {
-    throw std::exception("histogram::append called with incompatible argument.");
+    throw std::runtime_error("histogram::append called with incompatible argument.");
   }
   counts_vect::const_iterator arg = h.counts_.begin();
   for (auto& x : counts_) x += *arg;
@@ -1,4 +1,6 @@
+#if defined(_MSC_VER)
 #pragma warning( disable : 4996 )   // suppress superflous MSVC  warning(s)
+#endif
 
 #include <stdexcept>
 #include <memory>
@@ -37,11 +39,12 @@ namespace cine2 {
     auto select_channel = [shift = 8 * channel](unsigned rgba) { 
       return (rgba & (0xff << shift)) >> shift; 
     };
-    const int n = dst.size();
-    float* pdst = dst.data();
+    const int dim = dst.dim();
     const unsigned* psrc = src.data();
-    for (int i=0; i<n; ++i, ++pdst, ++psrc) {
-      *pdst = static_cast<float>(select_channel(*psrc)) / 255.0f;
+    for (int y=0; y<dim; ++y) {
+      for (int x=0; x<dim; ++x, ++psrc) {
+        dst.data()[dst.index(x, y)] = static_cast<float>(select_channel(*psrc)) / 255.0f;
+      }
     }
   }
 
@@ -54,11 +57,13 @@ namespace cine2 {
     auto set_channel = [=](unsigned char& c, float val) { 
       c = static_cast<unsigned char>(std::min(val, 255.0f));
     };
-    const int n = dst.width() * dst.height();
+    const int dim = src.dim();
     unsigned char* pdst = (unsigned char*)(dst.data()) + channel;
     const float* psrc = src.data();
-    for (int i=0; i<n; ++i, pdst += 4, ++psrc) {
-      set_channel(*pdst, *psrc);
+    for (int y=0; y<dim; ++y) {
+      for (int x=0; x<dim; ++x, pdst += 4) {
+        set_channel(*pdst, psrc[src.index(x, y)]);
+      }
     }
   }
 
@@ -71,11 +76,13 @@ namespace cine2 {
 	  auto set_channel = [=](unsigned char& c, float val) {
 		  c = static_cast<unsigned char>(std::max(0.0f, std::min((val / scale), 1.0f)) * 255.0f);
 	  };
-	  const int n = dst.width() * dst.height();
+	  const int dim = src.dim();
 	  unsigned char* pdst = (unsigned char*)(dst.data()) + channel;
 	  const float* psrc = src.data();
-	  for (int i = 0; i < n; ++i, pdst += 4, ++psrc) {
-		  set_channel(*pdst, *psrc);
+	  for (int y = 0; y < dim; ++y) {
+		  for (int x = 0; x < dim; ++x, pdst += 4) {
+			  set_channel(*pdst, psrc[src.index(x, y)]);
+		  }
 	  }
   }
 
@@ -85,16 +92,17 @@ namespace cine2 {
     auto set_channel = [=](unsigned char& c, float val) {
       c = static_cast<unsigned char>(val);
     };
-    const int n = src.dim() * src.dim();
+    const int dim = src.dim();
     const float* psrc = src.data();
-    for (int i = 0; i < n; ++i, ++psrc) {
-      if ((i + 1) % src.dim() == 0 && i > 0) {
-        ofs << *psrc << "\n";
-      } 
-      else {
-        ofs << *psrc << "\t";
+    for (int y = 0; y < dim; ++y) {
+      for (int x = 0; x < dim; ++x) {
+        if (x == dim - 1) {
+          ofs << psrc[src.index(x, y)] << "\n";
+        } 
+        else {
+          ofs << psrc[src.index(x, y)] << "\t";
+        }
       }
-
     }
   }
 
@@ -1,9 +1,12 @@
 #ifndef CINE2_INDIVIDUALS_H_INCLUDED
 #define CINE2_INDIVIDUALS_H_INCLUDED
 
-#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <new>
 #include <type_traits>
-#include <iterator>
+#include <utility>
+#include <xmmintrin.h>
 #include "rndutils.hpp"
 #include "ann.hpp"
 #include "rnd.hpp"
@@ -13,53 +16,83 @@
 namespace cine2 {
 
 
-  struct Individual
-  {
-    Individual() : pos(0, 0), food(0), foraging(false), handling(false), just_lost(false), handle_time(0), forage_count(0.f), handle_count(0), ancestor(0)
-    {
-    }
+  class Individuals;
+
 
-    void sprout(Coordinate Pos, int ancestor_idx)
+  /// \brief  View of one individual in Individuals.
+  ///
+  /// Cheap to copy, refers to individual idx() of its population.
+  /// IndividualView<true> is the read-only variant.
+  template <bool Const>
+  class IndividualView
+  {
+    using pop_t = std::conditional_t<Const, const Individuals, Individuals>;
+    template <typename T> using ref_t = std::conditional_t<Const, const T&, T&>;
+
+  public:
+    IndividualView(pop_t& pop, int idx) : pop_(&pop), idx_(idx) {}
+    operator IndividualView<true>() const { return { *pop_, idx_ }; }
+
+    int idx() const { return idx_; }
+
+    ref_t<Coordinate> pos() const;
+    ref_t<float> food() const;
+    ref_t<int> handle_time() const;
+    ref_t<float> handle_count() const;
+    ref_t<float> forage_count() const;
+    ref_t<int> ancestor() const;
+
+    bool foraging() const;
+    bool handling() const;
+    bool just_lost() const;
+    bool handled() const;
+    void foraging(bool val) const;
+    void handling(bool val) const;
+    void just_lost(bool val) const;
+    void handled(bool val) const;
+
+    void sprout(Coordinate Pos, int ancestor_idx) const
     {
-      pos = Pos;
-      food = 0.f;
-      handle_count = 0;
-      forage_count = 0;
-      foraging = false;
-      handling = false;
-	    just_lost = false;
-      handle_time = 0;
-      ancestor = ancestor_idx;
+      pos() = Pos;
+      food() = 0.f;
+      handle_count() = 0;
+      forage_count() = 0;
+      foraging(false);
+      handling(false);
+      just_lost(false);
+      handled(false);
+      handle_time() = 0;
+      ancestor() = ancestor_idx;
     }
 
-    bool alive() const { return food >= 0.f; }
-    bool handle() const { return handling; }
-    void forage(bool decision) {
-      foraging = decision;
+    bool alive() const { return food() >= 0.f; }
+    bool handle() const { return handling(); }
+    void forage(bool decision) const {
+      foraging(decision);
       if (decision) {
-        forage_count += 1.f;
+        forage_count() += 1.f;
       }
     }
 
-    void pick_item(int h_time) {
-      handle_time = -h_time;			//handling time is setted	[WE SHOULD MAKE THIS A PARAMETER IN "CONFIG.INI"]
+    void pick_item(int h_time) const {
+      handle_time() = -h_time;			//handling time is setted	[WE SHOULD MAKE THIS A PARAMETER IN "CONFIG.INI"]
 
-      handling = true;			//agend handling status is set to true
+      handling(true);			//agend handling status is set to true
 
     }
 
-    //HANDLING FUNCTION (per agent)
-    bool do_handle() {
-      if (handle_time < 0 && handling) {		//if agent handling time is smaller than zero AND agent is handling 
-        ++handle_time;								//handling time is udpated
-        handle_count += 1.f;
+    //HANDLING FUNCTION (per agent), see Individuals::do_handle for all agents at once
+    bool do_handle() const {
+      if (handle_time() < 0 && handling()) {		//if agent handling time is smaller than zero AND agent is handling
+        ++handle_time();								//handling time is udpated
+        handle_count() += 1.f;
 
         return false;
       }
-      if (handle_time == 0 && handling) {		//if handling time has reached zero AND agent is handling
-        food += 1.0f;								//food is consumed
-        handle_count += 1.f;
-        handling = false;							//the handling status is resetted (FALSE)
+      if (handle_time() == 0 && handling()) {		//if handling time has reached zero AND agent is handling
+        food() += 1.0f;								//food is consumed
+        handle_count() += 1.f;
+        handling(false);							//the handling status is resetted (FALSE)
 
         return true;
       }
@@ -68,46 +101,224 @@ namespace cine2 {
       }//ELSE (agent is not handling), do nothig.
     }
 
-    void flee(const Landscape& landscape, int flee_radius) {
+    template <typename URNG>
+    void flee(const Landscape& landscape, int flee_radius, URNG& reng) const {
 
-      if (handling) {
+      if (handling()) {
         std::uniform_int_distribution<int> dxy(-flee_radius, flee_radius);	//uniform distribution of the fleeing distance
-        pos = landscape.wrap(pos + Coordinate{ short(dxy(rnd::reng)), short(dxy(rnd::reng)) });		//new position with difference in coordinates sampled form previous distribution
+        pos() = landscape.wrap(pos() + Coordinate{ short(dxy(reng)), short(dxy(reng)) });		//new position with difference in coordinates sampled form previous distribution
 
       }
-      just_lost = true;
-      handling = false;				//handling status reset to false
-      handle_time = 0;				//handling time reset to 0 
+      just_lost(true);
+      handling(false);				//handling status reset to false
+      handle_time() = 0;				//handling time reset to 0
     };
 
 
-    void attacker_flee(const Landscape& landscape, int flee_radius) {
+    template <typename URNG>
+    void attacker_flee(const Landscape& landscape, int flee_radius, URNG& reng) const {
 
 
       std::uniform_int_distribution<int> dxy(-flee_radius, flee_radius);	//uniform distribution of the fleeing distance
-      pos = landscape.wrap(pos + Coordinate{ short(dxy(rnd::reng)), short(dxy(rnd::reng)) });		//new position with difference in coordinates sampled form previous distribution
+      pos() = landscape.wrap(pos() + Coordinate{ short(dxy(reng)), short(dxy(reng)) });		//new position with difference in coordinates sampled form previous distribution
 
-      handling = false;				//handling status reset to false
-      handle_time = 0;				//handling time reset to 0 
+      handling(false);				//handling status reset to false
+      handle_time() = 0;				//handling time reset to 0
     };
 
-    void die() { food = -1.f; }
-
-    Coordinate pos;
-    float food;
-    bool foraging;
-    bool handling;
-	  bool just_lost;
-    int handle_time;
-    float handle_count;
-    float forage_count;
-    int ancestor;
+    void die() const { food() = -1.f; }
+
+  private:
+    pop_t* pop_;
+    int idx_;
+  };
+
+
+  using Individual = IndividualView<false>;
+  using ConstIndividual = IndividualView<true>;
+
+
+  /// \brief  Population storage, structure of arrays.
+  ///
+  /// One 64 byte aligned array per field, the boolean states are
+  /// bit-packed into one flags byte per individual. Phases that touch
+  /// a few fields only stream these; operator[] returns an Individual
+  /// view for code that wants the per-agent interface.
+  class Individuals
+  {
+  public:
+    /// \brief  Bits in flags().
+    enum Flags : uint8_t {
+      foraging = 1 << 0,
+      handling = 1 << 1,
+      just_lost = 1 << 2,
+      handled = 1 << 3,     // done handling in this timestep
+    };
+
+    Individuals() : N_(0), data_(nullptr)
+    {
+      bind();
+    }
+
+    /// \brief  Creates N individuals at (0,0), not foraging, not handling.
+    ///
+    /// \exception  std::bad_alloc  Thrown when a bad Allocate error condition occurs.
+    explicit Individuals(int N) : Individuals()
+    {
+      data_ = (char*)_mm_malloc(mem_size(N), 64);
+      if (data_ == nullptr) throw std::bad_alloc();
+      N_ = N;
+      bind();
+      std::memset(data_, 0, mem_size(N_));
+    }
+
+    Individuals(Individuals&& rhs) noexcept : Individuals()
+    {
+      *this = std::move(rhs);
+    }
+
+    Individuals& operator=(Individuals&& rhs) noexcept
+    {
+      std::swap(N_, rhs.N_);
+      std::swap(data_, rhs.data_);
+      bind();
+      rhs.bind();
+      return *this;
+    }
+
+    Individuals(const Individuals& rhs) : Individuals(rhs.N_)
+    {
+      std::memcpy(data_, rhs.data_, mem_size(N_));
+    }
+
+    Individuals& operator=(const Individuals& rhs)
+    {
+      Individuals tmp(rhs);
+      *this = std::move(tmp);
+      return *this;
+    }
+
+    ~Individuals()
+    {
+      _mm_free(data_);
+    }
+
+    int size() const { return N_; }
+
+    /// \brief  Raw memory of all fields, mem_size() bytes.
+    void* data() { return data_; }
+    const void* data() const { return data_; }
+    size_t mem_size() const { return mem_size(N_); }
+
+    Individual operator[](int idx) { return { *this, idx }; }
+    ConstIndividual operator[](int idx) const { return { *this, idx }; }
+
+    Coordinate* pos() { return pos_; }
+    float* food() { return food_; }
+    uint8_t* flags() { return flags_; }
+    int* handle_time() { return handle_time_; }
+    float* handle_count() { return handle_count_; }
+    float* forage_count() { return forage_count_; }
+    int* ancestor() { return ancestor_; }
+
+    const Coordinate* pos() const { return pos_; }
+    const float* food() const { return food_; }
+    const uint8_t* flags() const { return flags_; }
+    const int* handle_time() const { return handle_time_; }
+    const float* handle_count() const { return handle_count_; }
+    const float* forage_count() const { return forage_count_; }
+    const int* ancestor() const { return ancestor_; }
+
+    /// \brief  Handling countdown of all individuals.
+    ///
+    /// Same as Individual::do_handle for every individual. The ones
+    /// that finished handling get the \c handled flag instead of the
+    /// return value.
+    void do_handle()
+    {
+      uint8_t* __restrict flg = flags_;
+      int* __restrict ht = handle_time_;
+      float* __restrict hc = handle_count_;
+      float* __restrict fd = food_;
+      ann_assume_aligned(flg, 64);
+      ann_assume_aligned(ht, 64);
+      ann_assume_aligned(hc, 64);
+      ann_assume_aligned(fd, 64);
+#     pragma omp parallel for simd schedule(static)
+      for (int i = 0; i < N_; ++i) {
+        const bool h = (flg[i] & handling) != 0;
+        const bool counting = h && (ht[i] < 0);
+        const bool done = h && (ht[i] == 0);
+        ht[i] += counting ? 1 : 0;
+        hc[i] += (counting || done) ? 1.f : 0.f;
+        fd[i] += done ? 1.f : 0.f;
+        flg[i] = done ? uint8_t((flg[i] & ~handling) | handled) : flg[i];
+      }
+    }
+
+  private:
+    // bytes per field, rounded up to cache lines
+    static size_t stride(int N, size_t size) { return (N * size + 63) & ~size_t(63); }
+
+    static size_t mem_size(int N)
+    {
+      return stride(N, sizeof(Coordinate)) + 4 * stride(N, sizeof(float)) + stride(N, 1) + stride(N, sizeof(int));
+    }
+
+    // sets the field pointers into data_
+    void bind()
+    {
+      char* p = data_;
+      auto next = [&p, N = N_](auto*& field) {
+        field = reinterpret_cast<std::remove_reference_t<decltype(field)>>(p);
+        p += stride(N, sizeof(*field));
+      };
+      next(pos_);
+      next(food_);
+      next(flags_);
+      next(handle_time_);
+      next(handle_count_);
+      next(forage_count_);
+      next(ancestor_);
+    }
+
+    int N_;
+    char* data_;
+    Coordinate* pos_;
+    float* food_;
+    uint8_t* flags_;
+    int* handle_time_;
+    float* handle_count_;
+    float* forage_count_;
+    int* ancestor_;
   };
 
 
+  template <bool Const> inline auto IndividualView<Const>::pos() const -> ref_t<Coordinate> { return pop_->pos()[idx_]; }
+  template <bool Const> inline auto IndividualView<Const>::food() const -> ref_t<float> { return pop_->food()[idx_]; }
+  template <bool Const> inline auto IndividualView<Const>::handle_time() const -> ref_t<int> { return pop_->handle_time()[idx_]; }
+  template <bool Const> inline auto IndividualView<Const>::handle_count() const -> ref_t<float> { return pop_->handle_count()[idx_]; }
+  template <bool Const> inline auto IndividualView<Const>::forage_count() const -> ref_t<float> { return pop_->forage_count()[idx_]; }
+  template <bool Const> inline auto IndividualView<Const>::ancestor() const -> ref_t<int> { return pop_->ancestor()[idx_]; }
+
+  template <bool Const> inline bool IndividualView<Const>::foraging() const { return pop_->flags()[idx_] & Individuals::foraging; }
+  template <bool Const> inline bool IndividualView<Const>::handling() const { return pop_->flags()[idx_] & Individuals::handling; }
+  template <bool Const> inline bool IndividualView<Const>::just_lost() const { return pop_->flags()[idx_] & Individuals::just_lost; }
+  template <bool Const> inline bool IndividualView<Const>::handled() const { return pop_->flags()[idx_] & Individuals::handled; }
 
+  namespace detail {
+
+    inline void set_flag(uint8_t& flags, uint8_t bit, bool val)
+    {
+      flags = val ? uint8_t(flags | bit) : uint8_t(flags & ~bit);
+    }
 
+  }
 
+  template <bool Const> inline void IndividualView<Const>::foraging(bool val) const { detail::set_flag(pop_->flags()[idx_], Individuals::foraging, val); }
+  template <bool Const> inline void IndividualView<Const>::handling(bool val) const { detail::set_flag(pop_->flags()[idx_], Individuals::handling, val); }
+  template <bool Const> inline void IndividualView<Const>::just_lost(bool val) const { detail::set_flag(pop_->flags()[idx_], Individuals::just_lost, val); }
+  template <bool Const> inline void IndividualView<Const>::handled(bool val) const { detail::set_flag(pop_->flags()[idx_], Individuals::handled, val); }
 
 }
 
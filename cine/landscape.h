@@ -2,12 +2,16 @@
 #define CINE2_LANDSCAPE_H_INCLUDED
 
 #include <cassert>
+#include <cstdint>
+#include <array>
 #include <cstring>      // memset
+#include <limits>
 #include <stdexcept>
+#include <iterator>
+#include <vector>
 #include <xmmintrin.h>
 #include "convolution.h"
 #include "ann.hpp"      // ann_assume_aligned
-#include "histogram.hpp"
 
 
 namespace cine2 {
@@ -30,34 +34,73 @@ namespace cine2 {
   inline Coordinate operator+=(Coordinate& a, Coordinate b) { a.x += b.x; a.y += b.y; return a; }
 
 
+  /// \return log2 of the POT x
+  inline int ilog2(int x)
+  {
+    int n = 0;
+    while ((1 << (n + 1)) <= x) ++n;
+    return n;
+  }
+
+
+  /// \brief  Memory index of the cell (x, y) of a tiled layer.
+  ///
+  /// The layer is stored in square tiles of 2^shift x 2^shift cells.
+  /// The tiles, and the cells within a tile, are row-major.
+  /// shift = log2(dim) is the plain row-major layout.
+  inline int cell_index(int x, int y, int dim, int shift)
+  {
+    const int mask = dim - 1;
+    const int m = (1 << shift) - 1;
+    x &= mask;
+    y &= mask;
+    return ((((y >> shift) * (dim >> shift)) + (x >> shift)) << (2 * shift)) | ((y & m) << shift) | (x & m);
+  }
+
+
   /// \brief  A View into an landscape layer.
-  class LayerView
+  ///
+  /// \tparam T  The element type of the layer.
+  template <typename T>
+  class BasicLayerView
   {
   public:
-    LayerView(float* data, int dim)
-      : dim_(dim), data_(data)
+    using value_type = T;
+
+    /// \param  tile_shift  log2 of the tile size, see cell_index. Defaults to row-major.
+    BasicLayerView(T* data, int dim, int tile_shift = -1)
+      : dim_(dim), shift_(tile_shift < 0 ? ilog2(dim) : tile_shift), data_(data)
     {
       assert((dim & (dim - 1)) == 0);
     }
 
     int dim() const { return dim_; }
     int size() const { return dim_ * dim_; }
-    int mem_size() const { return dim_ * dim_ * sizeof(float); }
+    size_t mem_size() const { return size_t(dim_) * dim_ * sizeof(T); }
+
+    /// \return log2 of the tile size
+    int tile_shift() const { return shift_; }
+
+    /// \return memory index of the cell (x, y), coordinates are wrapped
+    int index(int x, int y) const { return cell_index(x, y, dim_, shift_); }
 
     void clear() { std::memset(data_, 0, mem_size()); }
 
-    float operator()(Coordinate coor) const 
+    /// \brief clears the rows [y0, y1)
+    ///
+    /// y0 and y1 shall be multiples of the tile size.
+    void clear_rows(int y0, int y1) { std::memset(data_ + dim_ * y0, 0, (y1 - y0) * dim_ * sizeof(T)); }
+
+    T operator()(Coordinate coor) const 
     { 
       ann_assume_aligned(data_, 32);
-      const int mask = dim_ - 1;
-      return data_[dim_ * (coor.y & mask) + (coor.x & mask)]; 
+      return data_[index(coor.x, coor.y)]; 
     }
   
-    float& operator()(Coordinate coor)
+    T& operator()(Coordinate coor)
     { 
       ann_assume_aligned(data_, 32);
-      const int mask = dim_ - 1;
-      return data_[dim_ * (coor.y & mask) + (coor.x & mask)]; 
+      return data_[index(coor.x, coor.y)]; 
     }
 
 
@@ -69,8 +112,16 @@ namespace cine2 {
     std::array<float, L*L> gather(Coordinate center) const
     {
       std::array<float, L*L> res;
+      if (const T* p = inner_square<L>(center)) {
+        // the square doesn't cross tile boundaries
+        const int stride = 1 << shift_;
+        for (int i = 0; i < L*L; ++i) {
+          res[i] = static_cast<float>(p[(i / L) * stride + (i % L)]);
+        }
+        return res;
+      }
       for (int i = 0; i < L*L; ++i) {
-        res[i] = this->operator()(center + Coordinate((i % L) - L/2, (i / L) - L/2));
+        res[i] = static_cast<float>(this->operator()(center + Coordinate((i % L) - L/2, (i / L) - L/2)));
       }
       return res;
     }
@@ -82,26 +133,129 @@ namespace cine2 {
     template <int L>
     void stamp_kernel(Coordinate center, const std::array<float, L*L>& kernel)
     {
+      if (T* p = const_cast<T*>(inner_square<L>(center))) {
+        const int stride = 1 << shift_;
+        for (int i = 0; i < L*L; ++i) {
+          p[(i / L) * stride + (i % L)] += kernel[i];
+        }
+        return;
+      }
       for (int i = 0; i < L*L; ++i) {
         this->operator()(center + Coordinate((i % L) - L/2, (i / L) - L/2)) += kernel[i];
       }
     }
 
-    const float* cbegin() const { return data_; }
-    const float* cend() const { return data_ + size(); }
-    float* begin() const { return data_; }
-    float* end() const { return data_ + size(); }
-    const float* data() const { return data_; }
-    float* data() { return data_; }
+    const T* cbegin() const { return data_; }
+    const T* cend() const { return data_ + size(); }
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size(); }
+    const T* data() const { return data_; }
+    T* data() { return data_; }
 
-    void copy(const LayerView& src) {
+    void copy(const BasicLayerView& src) {
       assert(dim_ == src.dim_);
       std::memcpy(data_, src.data_, mem_size());
     }
 
   private:
+    // top left cell of the L x L square around center if the square
+    // lies inside one tile, nullptr otherwise
+    template <int L>
+    const T* inner_square(Coordinate center) const
+    {
+      const int m = (1 << shift_) - 1;
+      const int x = center.x & m;
+      const int y = center.y & m;
+      if (x < L/2 || x > m - L/2 || y < L/2 || y > m - L/2) return nullptr;
+      return data_ + index(center.x - L/2, center.y - L/2);
+    }
+
     int dim_;
-    float* data_;
+    int shift_;
+    T* data_;
+  };
+
+
+  using LayerView = BasicLayerView<float>;       // densities, records, ...
+  using ItemLayerView = BasicLayerView<uint8_t>;   // items
+  using CountLayerView = BasicLayerView<uint16_t>; // *_count, saturating
+
+
+  /// \brief  Cell -> agents lookup table.
+  ///
+  /// Counting sort of agent indices by the cell they occupy.
+  /// The agents of one cell are stored contiguously and in
+  /// ascending index order, unless reordered by the caller.
+  /// Cells are numbered by their memory index in the layers.
+  class AgentIndex
+  {
+  public:
+    AgentIndex() : dim_(0), shift_(0) {}
+
+    int dim() const { return dim_; }
+
+    /// \return number of indexed agents
+    int size() const { return static_cast<int>(agents_.size()); }
+
+    /// \brief  (Re-)builds the index from the agents in pop.
+    ///
+    /// Agent i refers to pop[i].
+    template <typename POP>
+    void build(const POP& pop, int dim, int tile_shift)
+    {
+      dim_ = dim;
+      shift_ = tile_shift;
+      const int DD = dim * dim;
+      const int N = pop.size();
+      const Coordinate* __restrict pos = pop.pos();
+      start_.assign(DD + 1, 0);
+      agents_.resize(N);
+      int* __restrict start = start_.data();
+      for (int i = 0; i < N; ++i) {
+        ++start[cell(pos[i])];
+      }
+      occupied_.clear();
+      int sum = 0;
+      for (int c = 0; c < DD; ++c) {
+        if (start[c]) occupied_.push_back(c);
+        start[c] = sum += start[c];   // end of cell c
+      }
+      start[DD] = N;
+      // reverse scatter keeps the agents of a cell in ascending order
+      // and leaves start[c] at the begin of cell c
+      for (int i = N - 1; i >= 0; --i) {
+        agents_[--start[cell(pos[i])]] = i;
+      }
+    }
+
+    /// \return cell index of coor
+    int cell(Coordinate coor) const
+    {
+      return cell_index(coor.x, coor.y, dim_, shift_);
+    }
+
+    /// \return number of agents in cell c
+    int count(int c) const { return start_[c + 1] - start_[c]; }
+
+    /// \return indices of the agents in cell c
+    const int* begin(int c) const { return agents_.data() + start_[c]; }
+    const int* end(int c) const { return agents_.data() + start_[c + 1]; }
+    int* begin(int c) { return agents_.data() + start_[c]; }
+    int* end(int c) { return agents_.data() + start_[c + 1]; }
+
+    /// \return indices of the agents at coor
+    const int* begin(Coordinate coor) const { return begin(cell(coor)); }
+    const int* end(Coordinate coor) const { return end(cell(coor)); }
+
+    /// \return the non-empty cells in ascending order
+    const std::vector<int>& occupied() const { return occupied_; }
+
+  private:
+    int dim_;
+    int shift_;
+    std::vector<int> start_;      // [dim * dim + 1] begin of cell c in agents_
+    std::vector<int> agents_;     // agent indices, sorted by cell
+    std::vector<int> occupied_;   // non-empty cells
   };
 
 
@@ -132,8 +286,38 @@ namespace cine2 {
       max_layer
     };
 
-    Landscape() : dim_(0), data_(nullptr)
+    /// \brief  Strategies for update_occupancy.
+    enum class Occupancy : int {
+      automatic = 0,  // select by agent density
+      scatter,        // stamp the kernel around every agent
+      convolve,       // count agents per cell, convolve the counts
+    };
+
+    /// \brief  Memory layout of the layers.
+    enum class Layout : int {
+      row_major = 0,  // rows of cells
+      tiled,          // row-major tiles of tile_dim x tile_dim cells, see cell_index
+    };
+
+    static constexpr int tile_dim = 16;
+
+    using item_t = ItemLayerView::value_type;
+    using count_t = CountLayerView::value_type;
+
+    /// \return the size of one element of layer [bytes].
+    ///
+    /// items and the *_count layers hold small integers and are stored
+    /// quantized, all other layers are float.
+    static constexpr int layer_elem_size(Layers layer)
+    {
+      return (layer == items) ? int(sizeof(item_t))
+        : (layer == foragers_count || layer == klepts_count || layer == handlers_count) ? int(sizeof(count_t))
+        : int(sizeof(float));
+    }
+
+    Landscape() : dim_(0), shift_(0), data_(nullptr), occupancy_(Occupancy::automatic)
     {
+      offset_.fill(0);
     }
 
     Landscape(Landscape&& rhs) : Landscape()
@@ -143,8 +327,12 @@ namespace cine2 {
 
     Landscape& operator=(Landscape&& rhs) noexcept
     {
-      dim_ = rhs.dim_; rhs.dim_ = 0;
-      data_ = rhs.data_; rhs.data_ = nullptr;
+      std::swap(dim_, rhs.dim_);
+      std::swap(shift_, rhs.shift_);
+      std::swap(data_, rhs.data_);
+      std::swap(offset_, rhs.offset_);
+      std::swap(agent_index_, rhs.agent_index_);
+      std::swap(occupancy_, rhs.occupancy_);
       return *this;
     }
 
@@ -153,21 +341,30 @@ namespace cine2 {
     /// \exception  std::runtime_error  Raised when a the dimension is not POT.
     /// \exception  std::bad_alloc      Thrown when a bad Allocate error condition occurs.
     ///
-    /// \param  dim The dimension of the landscape.
-    explicit Landscape(int dim) : Landscape()
+    /// \param  dim     The dimension of the landscape.
+    /// \param  layout  The memory layout of the layers.
+    explicit Landscape(int dim, Layout layout = Layout::row_major) : Landscape()
     {
       if ((dim & (dim - 1)) != 0) {
         throw std::runtime_error("Landscape dimension shall be POT");
       }
-      data_ = (float*)_mm_malloc(Layers::max_layer * dim * dim * sizeof(float), 64);
+      // layers start at cache line boundaries
+      for (int l = 0; l < Layers::max_layer; ++l) {
+        const size_t bytes = size_t(dim) * dim * layer_elem_size(Layers(l));
+        offset_[l + 1] = offset_[l] + ((bytes + 63) & ~size_t(63));
+      }
+      data_ = (char*)_mm_malloc(offset_[Layers::max_layer], 64);
       if (data_ == nullptr) throw std::bad_alloc();
       dim_ = dim;
+      shift_ = (layout == Layout::tiled && dim > tile_dim) ? ilog2(tile_dim) : ilog2(dim);
       std::memset(data_, 0, mem_size());
     }
 
-    Landscape(const Landscape& rhs) : Landscape(rhs.dim_)
+    Landscape(const Landscape& rhs) : Landscape(rhs.dim_, rhs.layout())
     {
       std::memcpy(data_, rhs.data_, mem_size());
+      agent_index_ = rhs.agent_index_;
+      occupancy_ = rhs.occupancy_;
     }
     
     Landscape& operator=(const Landscape& rhs)
@@ -186,11 +383,20 @@ namespace cine2 {
     /// \return the dimension of the landscape.
     int dim() const { return dim_; }
 
+    /// \return the memory layout of the layers.
+    Layout layout() const { return (dim_ > 0 && (1 << shift_) < dim_) ? Layout::tiled : Layout::row_major; }
+
+    /// \return log2 of the tile size, log2(dim) if row-major.
+    int tile_shift() const { return shift_; }
+
+    /// \return memory index of the cell (x, y) in the layers.
+    int index(int x, int y) const { return cell_index(x, y, dim_, shift_); }
+
     /// \return the total size of all layers in memory [bytes].
-    int mem_size() const { return Layers::max_layer * dim_ * dim_ * sizeof(float); }
+    size_t mem_size() const { return offset_[Layers::max_layer]; }
 
-    /// \return the size of a layers in memory [bytes].
-    int layer_mem_size() const { return dim_ * dim_ * sizeof(float); }
+    /// \return the size of a layer in memory [bytes].
+    size_t layer_mem_size(Layers layer) const { return size_t(dim_) * dim_ * layer_elem_size(layer); }
 
     Coordinate wrap(Coordinate coor) const
     {
@@ -199,84 +405,339 @@ namespace cine2 {
       return coor;
     }
 
-    /// \return LayerView of the indexed value.
-    LayerView get_layer(Layers layer) { return LayerView(data_ + layer * dim_ * dim_, dim_); }
+    /// \return typed view of layer.
+    ///
+    /// \tparam T  The element type of layer, see layer_elem_size.
+    template <typename T>
+    BasicLayerView<T> get_layer(Layers layer) const
+    {
+      assert(sizeof(T) == layer_elem_size(layer) && "layer type mismatch");
+      return BasicLayerView<T>(reinterpret_cast<T*>(data_ + offset_[layer]), dim_, shift_);
+    }
+
+    /// \return LayerView of the indexed float layer.
+    LayerView get_layer(Layers layer) { return get_layer<float>(layer); }
   
   
-    /// \return LayerView of the indexed value.
-    const LayerView get_layer(Layers layer) const { return LayerView(data_ + layer * dim_ * dim_, dim_); }
+    /// \return LayerView of the indexed float layer.
+    const LayerView get_layer(Layers layer) const { return get_layer<float>(layer); }
 
 
-    /// \param  layer The layer.
+    /// \param  layer The float layer.
     ///
     /// \return LayerView of the indexed value.
     LayerView operator[](Layers layer) { return get_layer(layer); }
 
-    /// \param  layer The layer.
+    /// \param  layer The float layer.
     ///
     /// \return LayerView of the indexed value.
     const LayerView operator[](Layers layer) const { return get_layer(layer); }
 
-    template <typename IT, typename Kernel>
-    void update_occupancy(Layers foragers_count, Layers foragers, Layers klepts_count, Layers klepts, Layers handlers_count, Layers handlers, Layers nonhandlers, IT first, IT last, const Kernel& kernel)
+    ItemLayerView items_layer() const { return get_layer<item_t>(Layers::items); }
+    CountLayerView count_layer(Layers layer) const { return get_layer<count_t>(layer); }
+
+    /// \brief  Gathers the cells in a square around center from any layer.
+    template <int L>
+    std::array<float, L*L> gather(Layers layer, Coordinate center) const
     {
+      switch (layer_elem_size(layer)) {
+        case sizeof(item_t): return get_layer<item_t>(layer).template gather<L>(center);
+        case sizeof(count_t): return get_layer<count_t>(layer).template gather<L>(center);
+        default: return get_layer<float>(layer).template gather<L>(center);
+      }
+    }
+
+    /// \brief  Copies any layer as row-major float array into dst[dim * dim].
+    void layer_to_float(Layers layer, float* dst) const
+    {
+      if (layout() == Layout::tiled) {
+        switch (layer_elem_size(layer)) {
+          case sizeof(item_t): to_row_major(get_layer<item_t>(layer), dst); break;
+          case sizeof(count_t): to_row_major(get_layer<count_t>(layer), dst); break;
+          default: to_row_major(get_layer<float>(layer), dst); break;
+        }
+        return;
+      }
+      switch (layer_elem_size(layer)) {
+        case sizeof(item_t): convert(get_layer<item_t>(layer), dst); break;
+        case sizeof(count_t): convert(get_layer<count_t>(layer), dst); break;
+        default: std::memcpy(dst, get_layer<float>(layer).data(), layer_mem_size(layer)); break;
+      }
+    }
+
+    /// \return float view of any layer.
+    ///
+    /// Quantized layers are converted into the temp layer, the
+    /// view is valid until temp is used otherwise.
+    LayerView as_float(Layers layer) const
+    {
+      if (layer_elem_size(layer) == sizeof(float)) return get_layer<float>(layer);
+      LayerView tmp = get_layer<float>(Layers::temp);
+      if (layer_elem_size(layer) == sizeof(item_t)) convert(get_layer<item_t>(layer), tmp.data());
+      else convert(get_layer<count_t>(layer), tmp.data());
+      return tmp;
+    }
+
+    /// \brief  Rows per band of the parallel occupancy update.
+    ///
+    /// Bands of the same parity are at least kernel_size - 1 rows apart,
+    /// thus they can be stamped concurrently. Bands are whole rows of
+    /// tiles, i.e. contiguous in memory. The band layout depends
+    /// on dim, layout and kernel_size only, the resulting layers don't
+    /// depend on the number of threads.
+    int occupancy_band_rows(int kernel_size) const
+    {
+      int rows = 1;
+      while (rows < kernel_size - 1 || rows < dim_ / 64 || rows < (1 << shift_)) rows <<= 1;
+      return (2 * rows <= dim_) ? rows : dim_;
+    }
+
+    /// \brief  Selects the occupancy strategy.
+    void occupancy(Occupancy strategy) { occupancy_ = strategy; }
+    Occupancy occupancy() const { return occupancy_; }
 
-      LayerView vforagers_count = get_layer(foragers_count);
+    /// \return the strategy update_occupancy uses for N agents.
+    ///
+    /// Scattering costs k^2 random updates per agent, convolving
+    /// O(k) vectorized madds per cell. The factor 0.1 is empirical,
+    /// convolving pays off above roughly 0.05 agents per cell (k = 3).
+    Occupancy select_occupancy(int N, int kernel_size) const
+    {
+      if (occupancy_ != Occupancy::automatic) return occupancy_;
+      const double scatter_cost = double(kernel_size) * kernel_size * N;
+      const double convolve_cost = 0.1 * (kernel_size + 2) * double(dim_) * dim_;
+      return (scatter_cost > convolve_cost) ? Occupancy::convolve : Occupancy::scatter;
+    }
+
+    /// \brief  Updates agent index, count layers and density layers.
+    ///
+    /// The density layers (foragers, klepts, handlers, nonhandlers) are
+    /// the counts of the respective agents convolved with kernel.
+    template <typename POP, typename Kernel>
+    void update_occupancy(Layers foragers_count, Layers foragers, Layers klepts_count, Layers klepts, Layers handlers_count, Layers handlers, Layers nonhandlers, const POP& pop, const Kernel& kernel)
+    {
+      // agents sorted by cell, i.e. by row of tiles
+      agent_index_.build(pop, dim_, shift_);
+      if (select_occupancy(agent_index_.size(), Kernel::k) == Occupancy::convolve) {
+        update_occupancy_convolve(foragers_count, foragers, klepts_count, klepts, handlers_count, handlers, nonhandlers, pop, kernel);
+      }
+      else {
+        update_occupancy_scatter(foragers_count, foragers, klepts_count, klepts, handlers_count, handlers, nonhandlers, pop, kernel);
+      }
+    }
+
+    template <typename POP, typename Kernel>
+    void update_occupancy_scatter(Layers foragers_count, Layers foragers, Layers klepts_count, Layers klepts, Layers handlers_count, Layers handlers, Layers nonhandlers, const POP& pop, const Kernel& kernel)
+    {
+
+      CountLayerView vforagers_count = count_layer(foragers_count);
       LayerView vforagers = get_layer(foragers);
-      LayerView vklepts_count = get_layer(klepts_count);
+      CountLayerView vklepts_count = count_layer(klepts_count);
       LayerView vklepts = get_layer(klepts);
-      LayerView vhandlers_count = get_layer(handlers_count);
+      CountLayerView vhandlers_count = count_layer(handlers_count);
       LayerView vhandlers = get_layer(handlers);
       LayerView vnonhandlers = get_layer(nonhandlers);
+      const Coordinate* __restrict pos = pop.pos();
+      const float* __restrict food = pop.food();
+      const uint8_t* __restrict flags = pop.flags();
 	  
       //Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers,
 
-	  //clearing the vectors before the visualization of the current timestep
-      vforagers_count.clear();
-      vforagers.clear();
-      vklepts_count.clear();
-      vklepts.clear();
-      vhandlers_count.clear();
-      vhandlers.clear();
-      vnonhandlers.clear();
-
-      for (; first != last; ++first) {		//cycle trough the agents
-        if (first->alive()) {				//if alive
-          if (first->handle()) {				//and handling
-            ++vhandlers_count(first->pos);					//position stored in the vector3 (for handlers apparently)
-            vhandlers.stamp_kernel<Kernel::k>(first->pos, kernel.K);
-
-            if (first->foraging) {
-              ++vforagers_count(first->pos);  
-            }
-            else {
-              ++vklepts_count(first->pos);
+      const int band_rows = occupancy_band_rows(Kernel::k);
+      const int bands = dim_ / band_rows;
+      const int tile = 1 << shift_;
+#     pragma omp parallel
+      {
+        //clearing the vectors before the visualization of the current timestep
+#       pragma omp for schedule(static)
+        for (int b = 0; b < bands; ++b) {
+          const int y0 = b * band_rows;
+          const int y1 = y0 + band_rows;
+          vforagers_count.clear_rows(y0, y1);
+          vforagers.clear_rows(y0, y1);
+          vklepts_count.clear_rows(y0, y1);
+          vklepts.clear_rows(y0, y1);
+          vhandlers_count.clear_rows(y0, y1);
+          vhandlers.clear_rows(y0, y1);
+          vnonhandlers.clear_rows(y0, y1);
+        }
 
+        // even bands first, odd bands second: the kernels stamped from
+        // concurrently processed bands never overlap
+        for (int parity = 0; parity < 2; ++parity) {
+#         pragma omp for schedule(dynamic)
+          for (int b = parity; b < bands; b += 2) {
+            // row by row, the kernels add up in the same order for any layout
+            for (int y = b * band_rows; y < (b + 1) * band_rows; ++y) {
+              for (int x = 0; x < dim_; x += tile) {
+                const int c = index(x, y);
+                const int* a = agent_index_.begin(c);
+                const int* const a_end = agent_index_.begin(c + tile);
+                for (; a != a_end; ++a) {		//cycle trough the agents in this band
+                  const Coordinate ipos = pos[*a];
+                  if (food[*a] >= 0.f) {				//if alive
+                    if (flags[*a] & POP::handling) {				//and handling
+                      count(vhandlers_count(ipos));					//position stored in the vector3 (for handlers apparently)
+                      vhandlers.stamp_kernel<Kernel::k>(ipos, kernel.K);
+
+                      if (flags[*a] & POP::foraging) {
+                        count(vforagers_count(ipos));  
+                      }
+                      else {
+                        count(vklepts_count(ipos));
+
+                      }
+                    }
+                    else if (flags[*a] & POP::foraging) {			//if not handling, but foraging
+                      count(vforagers_count(ipos));					//position stored in vector1 (for foragers)
+                      vforagers.stamp_kernel<Kernel::k>(ipos, kernel.K);
+                      vnonhandlers.stamp_kernel<Kernel::k>(ipos, kernel.K);
+                    }
+                    else {								//if not handling and not foragers (they are kleptoparasytes)
+                      count(vklepts_count(ipos));					//position stored in vector2 (for klepts)
+                      vklepts.stamp_kernel<Kernel::k>(ipos, kernel.K);
+                      vnonhandlers.stamp_kernel<Kernel::k>(ipos, kernel.K);
+
+                    }
+
+                  }
+                }
+              }
             }
           }
-          else if (first->foraging) {			//if not handling, but foraging
-            ++vforagers_count(first->pos);					//position stored in vector1 (for foragers)
-            vforagers.stamp_kernel<Kernel::k>(first->pos, kernel.K);
-            vnonhandlers.stamp_kernel<Kernel::k>(first->pos, kernel.K);
-          }
-          else {								//if not handling and not foragers (they are kleptoparasytes)
-            ++vklepts_count(first->pos);					//position stored in vector2 (for klepts)
-            vklepts.stamp_kernel<Kernel::k>(first->pos, kernel.K);
-            vnonhandlers.stamp_kernel<Kernel::k>(first->pos, kernel.K);
+        }
+      }
+    }
+
 
-          }
 
+    template <typename POP, typename Kernel>
+    void update_occupancy_convolve(Layers foragers_count, Layers foragers, Layers klepts_count, Layers klepts, Layers handlers_count, Layers handlers, Layers nonhandlers, const POP& pop, const Kernel& kernel)
+    {
+      CountLayerView vforagers_count = count_layer(foragers_count);
+      LayerView vforagers = get_layer(foragers);
+      CountLayerView vklepts_count = count_layer(klepts_count);
+      LayerView vklepts = get_layer(klepts);
+      CountLayerView vhandlers_count = count_layer(handlers_count);
+      LayerView vhandlers = get_layer(handlers);
+      LayerView vnonhandlers = get_layer(nonhandlers);
+      LayerView vtemp = get_layer(Layers::temp);
+      const Coordinate* __restrict pos = pop.pos();
+      const float* __restrict food = pop.food();
+      const uint8_t* __restrict flags = pop.flags();
+
+      // count: foragers, klepts and handlers receive the float counts of
+      // the non-handling foragers, non-handling klepts and handlers
+      const int band_rows = occupancy_band_rows(1);
+      const int bands = dim_ / band_rows;
+#     pragma omp parallel for schedule(static)
+      for (int b = 0; b < bands; ++b) {
+        const int y0 = b * band_rows;
+        const int y1 = y0 + band_rows;
+        vforagers_count.clear_rows(y0, y1);
+        vforagers.clear_rows(y0, y1);
+        vklepts_count.clear_rows(y0, y1);
+        vklepts.clear_rows(y0, y1);
+        vhandlers_count.clear_rows(y0, y1);
+        vhandlers.clear_rows(y0, y1);
+        const int* a = agent_index_.begin(dim_ * y0);
+        const int* const a_end = agent_index_.begin(dim_ * y1);
+        for (; a != a_end; ++a) {
+          const Coordinate ipos = pos[*a];
+          if (food[*a] >= 0.f) {    // alive
+            if (flags[*a] & POP::handling) {
+              count(vhandlers_count(ipos));
+              ++vhandlers(ipos);
+              if (flags[*a] & POP::foraging) count(vforagers_count(ipos)); else count(vklepts_count(ipos));
+            }
+            else if (flags[*a] & POP::foraging) {
+              count(vforagers_count(ipos));
+              ++vforagers(ipos);
+            }
+            else {
+              count(vklepts_count(ipos));
+              ++vklepts(ipos);
+            }
+          }
         }
       }
+
+      // convolve
+      convolve_separable<Kernel::k>(vforagers.data(), vforagers.data(), vtemp.data(), dim_, shift_, kernel.K1);
+      convolve_separable<Kernel::k>(vklepts.data(), vklepts.data(), vtemp.data(), dim_, shift_, kernel.K1);
+      convolve_separable<Kernel::k>(vhandlers.data(), vhandlers.data(), vtemp.data(), dim_, shift_, kernel.K1);
+      const float* __restrict pf = vforagers.data();
+      const float* __restrict pk = vklepts.data();
+      float* __restrict pn = vnonhandlers.data();
+      const int DD = dim_ * dim_;
+#     pragma omp parallel for simd schedule(static)
+      for (int i = 0; i < DD; ++i) {
+        pn[i] = pf[i] + pk[i];
+      }
     }
 
 
+    /// \brief  Rebuilds the agent index only.
+    ///
+    /// Use after agents were displaced without the need for fresh
+    /// occupancy layers.
+    template <typename POP>
+    void update_agent_index(const POP& pop)
+    {
+      agent_index_.build(pop, dim_, shift_);
+    }
+
+    /// \return the cell -> agents table of the last update.
+    const AgentIndex& agent_index() const { return agent_index_; }
+    AgentIndex& agent_index() { return agent_index_; }
 
-    const float* data() const { return data_; }
+    /// \return the first layer. foragers, klepts and handlers are
+    /// consecutive float layers in layout() order, see layer_to_float.
+    /// The layers are mem_size() bytes of contiguous memory.
+    const float* data() const { return reinterpret_cast<const float*>(data_); }
+    float* data() { return reinterpret_cast<float*>(data_); }
 
   private:
+    template <typename T>
+    static void convert(BasicLayerView<T> src, float* __restrict dst)
+    {
+      const T* __restrict p = src.data();
+      const int n = src.size();
+#     pragma omp parallel for simd schedule(static)
+      for (int i = 0; i < n; ++i) {
+        dst[i] = static_cast<float>(p[i]);
+      }
+    }
+
+    template <typename T>
+    static void to_row_major(BasicLayerView<T> src, float* __restrict dst)
+    {
+      const T* __restrict p = src.data();
+      const int dim = src.dim();
+      const int tile = 1 << src.tile_shift();
+#     pragma omp parallel for schedule(static)
+      for (int y = 0; y < dim; ++y) {
+        for (int x = 0; x < dim; x += tile) {
+          const T* __restrict s = p + src.index(x, y);
+          float* __restrict d = dst + y * dim + x;
+#         pragma omp simd
+          for (int i = 0; i < tile; ++i) d[i] = static_cast<float>(s[i]);
+        }
+      }
+    }
+
+    // saturating increment for the count layers
+    static void count(count_t& c)
+    {
+      c += (c != std::numeric_limits<count_t>::max()) ? 1 : 0;
+    }
+
     int dim_;
-    float* data_;
+    int shift_;         // log2 of the tile size
+    char* data_;
+    std::array<size_t, Layers::max_layer + 1> offset_;    // byte offsets of the layers
+    AgentIndex agent_index_;
+    Occupancy occupancy_;
   };
 
 }
@@ -6,6 +6,7 @@
 #include <streambuf>
 #include <filesystem>
 #include "parameter.h"
+#include "checkpoint.h"
 
 
 namespace filesystem = std::filesystem;
@@ -33,6 +34,16 @@ namespace cine2 {
     clp_optional_val(outdir, std::string{});
     clp_optional_val(omp_threads, omp_get_max_threads());
     omp_set_num_threads(param.omp_threads);
+    clp_optional_val(resume, std::string{});
+    clp_optional_val(replay.file, std::string{});
+    if (!param.resume.empty() && !param.replay.file.empty()) throw cmd::parse_error("resume and replay.file are exclusive");
+    const std::string& restore = param.resume.empty() ? param.replay.file : param.resume;
+    if (restore.empty()) {
+      clp_optional_val(seed, rndutils::make_random_engine<>()());   // streamed: re-run with seed=...
+    }
+    else {
+      clp_optional_val(seed, checkpoint_seed(restore));             // the streams of the restored run
+    }
 
     clp_required(agents.N);
     clp_optional_val(agents.L, 3);
@@ -48,6 +59,12 @@ namespace cine2 {
     clp_optional_val(agents.mutation_knockout, 0.001f);
     clp_optional_val(agents.noise_sigma, 0.1f);
     clp_optional_val(agents.cmplx_penalty, 0.01f);
+    {
+      const auto reproduction = clp.optional_val("agents.reproduction", std::string("alias"));
+      if (reproduction == "alias") param.agents.reproduction = Reproduction::alias;
+      else if (reproduction == "systematic") param.agents.reproduction = Reproduction::systematic;
+      else throw cmd::parse_error("agents.reproduction shall be alias or systematic");
+    }
 
     param.agents.input_layers = { { Layers::nonhandlers, Layers::handlers, Layers::items } };
     clp_optional_vec(agents.input_layers, param.agents.input_layers);
@@ -57,12 +74,68 @@ namespace cine2 {
 
 
     clp_optional_val(landscape.max_item_cap, /*1.0f*/10.0f);
+    if (param.landscape.max_item_cap < 0.f || param.landscape.max_item_cap >= 256.f) throw cmd::parse_error("landscape.max_item_cap shall be in [0, 256)");
 	clp_optional_val(landscape.item_growth,/*0.01f*/0.01f);
 	clp_optional_val(landscape.detection_rate, 0.1f);
+    {
+      const auto occupancy = clp.optional_val("landscape.occupancy", std::string("auto"));
+      if (occupancy == "auto") param.landscape.occupancy = Landscape::Occupancy::automatic;
+      else if (occupancy == "scatter") param.landscape.occupancy = Landscape::Occupancy::scatter;
+      else if (occupancy == "convolve") param.landscape.occupancy = Landscape::Occupancy::convolve;
+      else throw cmd::parse_error("landscape.occupancy shall be auto, scatter or convolve");
+    }
+    {
+      const auto layout = clp.optional_val("landscape.layout", std::string("row_major"));
+      if (layout == "row_major") param.landscape.layout = Landscape::Layout::row_major;
+      else if (layout == "tiled") param.landscape.layout = Landscape::Layout::tiled;
+      else throw cmd::parse_error("landscape.layout shall be row_major or tiled");
+    }
+    {
+      const auto regrowth = clp.optional_val("landscape.regrowth", std::string("wheel"));
+      if (regrowth == "wheel") param.landscape.regrowth = Regrowth::wheel;
+      else if (regrowth == "sweep") param.landscape.regrowth = Regrowth::sweep;
+      else throw cmd::parse_error("landscape.regrowth shall be wheel or sweep");
+    }
 	clp_required(landscape.capacity.image);
     param.landscape.capacity.channel = ImageChannel(clp.required<int>("landscape.capacity.channel"));
     param.landscape.capacity.layer = Landscape::Layers::capacity;
 
+    clp_optional_val(archive.threads, 2);
+    if (param.archive.threads < 0) throw cmd::parse_error("archive.threads shall be >= 0");
+    clp_optional_val(archive.pending, 20);
+    if (param.archive.pending < 1) throw cmd::parse_error("archive.pending shall be > 0");
+    {
+      const auto codec = clp.optional_val("archive.codec", std::string("deflate"));
+      if (codec == "deflate") param.archive.codec.id = archive::codec::deflate;
+      else if (codec == "lz4") param.archive.codec.id = archive::codec::lz4;
+      else if (codec == "store") param.archive.codec.id = archive::codec::store;
+      else throw cmd::parse_error("archive.codec shall be deflate, lz4 or store");
+    }
+    param.archive.codec.level = clp.optional_val("archive.level", 6);
+    if (param.archive.codec.level < 1 || param.archive.codec.level > 9) throw cmd::parse_error("archive.level shall be in [1, 9]");
+    {
+      const auto filter = clp.optional_val("archive.filter", std::string("none"));
+      if (filter == "none") param.archive.codec.filters = archive::no_filter;
+      else if (filter == "shuffle") param.archive.codec.filters = archive::shuffle;
+      else if (filter == "bitshuffle") param.archive.codec.filters = archive::bitshuffle;
+      else throw cmd::parse_error("archive.filter shall be none, shuffle or bitshuffle");
+    }
+    param.archive.codec.keyframe = clp.optional_val("archive.keyframe", 0);
+    if (param.archive.codec.keyframe < 0) throw cmd::parse_error("archive.keyframe shall be >= 0");
+
+    clp_optional_val(checkpoint.every, 0);
+    if (param.checkpoint.every < 0) throw cmd::parse_error("checkpoint.every shall be >= 0");
+    clp_optional_val(checkpoint.file, (param.outdir.empty() ? filesystem::path("checkpoint.bin") : filesystem::path(param.outdir) / "checkpoint.bin").string());
+
+    clp_optional_val(replay.every, 0);
+    if (param.replay.every < 0) throw cmd::parse_error("replay.every shall be >= 0");
+    if (param.replay.every && param.outdir.empty()) throw cmd::parse_error("replay.every requires outdir");
+
+    clp_optional_val(profile.trace, std::string{});
+    clp_optional_val(profile.summary, std::string{});
+    clp_optional_val(profile.every, 1);
+    if (param.profile.every < 1) throw cmd::parse_error("profile.every shall be >= 1");
+
     clp_optional_val(gui.wait_for_close, true);
     param.gui.selected = { { true, true, true, false } };
     clp_optional_vec(gui.selected, param.gui.selected);
@@ -91,6 +164,12 @@ namespace cine2 {
 
   namespace {
 
+    const char* occupancy_names[] = { "auto", "scatter", "convolve" };
+    const char* layout_names[] = { "row_major", "tiled" };
+    const char* regrowth_names[] = { "wheel", "sweep" };
+    const char* reproduction_names[] = { "alias", "systematic" };
+    const char* filter_names[] = { "none", "shuffle", "bitshuffle" };
+
     template <typename C>
     std::ostream& do_stream_array(std::ostream& os, const char* name, const C& cont, const char* lb, const char* rb)
     {
@@ -119,6 +198,7 @@ namespace cine2 {
     stream(Tfix);
     stream_str(outdir);
     stream(omp_threads);
+    stream(seed);
     os << '\n';
 
     stream(agents.N);
@@ -134,6 +214,7 @@ namespace cine2 {
     stream(agents.mutation_knockout);
     stream(agents.noise_sigma);
     stream(agents.cmplx_penalty);
+    os << prefix << "agents.reproduction=\"" << reproduction_names[static_cast<int>(param.agents.reproduction)] << '"' << postfix;
     stream_array(agents.input_layers);
     stream_array(agents.input_mask);
     os << '\n';
@@ -143,8 +224,25 @@ namespace cine2 {
     stream(landscape.max_item_cap);
 	stream(landscape.item_growth);
 	stream(landscape.detection_rate); //*&*
+    os << prefix << "landscape.occupancy=\"" << occupancy_names[static_cast<int>(param.landscape.occupancy)] << '"' << postfix;
+    os << prefix << "landscape.layout=\"" << layout_names[static_cast<int>(param.landscape.layout)] << '"' << postfix;
+    os << prefix << "landscape.regrowth=\"" << regrowth_names[static_cast<int>(param.landscape.regrowth)] << '"' << postfix;
 	stream_str(landscape.capacity.image);
     stream(landscape.capacity.channel);
+    os << '\n';
+
+    stream(archive.threads);
+    stream(archive.pending);
+    os << prefix << "archive.codec=\"" << archive::get_codec(param.archive.codec.id).name << '"' << postfix;
+    os << prefix << "archive.level=" << param.archive.codec.level << postfix;
+    os << prefix << "archive.filter=\"" << filter_names[param.archive.codec.filters] << '"' << postfix;
+    os << prefix << "archive.keyframe=" << param.archive.codec.keyframe << postfix;
+    stream(checkpoint.every);
+    stream_str(checkpoint.file);
+    stream(replay.every);
+    stream_str(profile.trace);
+    stream_str(profile.summary);
+    stream(profile.every);
 
     return os;
   }
@@ -7,12 +7,15 @@
 #include <array>
 #include <deque>
 #include "landscape.h"
+#include "regrowth.h"
 #include "rnd.hpp"
 #include "individuals.h"
 #include "convolution.h"
 #include "image.h"
 #include "ann.hpp"
 #include "cmd_line.h"
+#include "archive.hpp"
+#include "profiler.h"
 
 
 namespace cine2 {
@@ -53,6 +56,13 @@ namespace cine2 {
   };
 
 
+  // Ancestor sampling in reproduction
+  enum class Reproduction : int {
+    alias = 0,      // independent draws from the fitness distribution
+    systematic,     // stochastic universal sampling, sorted ancestors
+  };
+
+
   struct Param
   {
     int Gburnin;          // burnin-generations
@@ -62,6 +72,7 @@ namespace cine2 {
     int Tfix;             // time ticks per fixed generation
     std::string outdir;   // output folder
     int omp_threads;
+    uint64_t seed;        // key of the counter-based random streams
 
     struct ind_param
     {
@@ -79,6 +90,7 @@ namespace cine2 {
       float mutation_knockout;
       float noise_sigma;
       float cmplx_penalty;
+      Reproduction reproduction;    // alias | systematic
 
       std::array<int, 3> input_layers;
       std::array<float, 3> input_mask;
@@ -87,9 +99,9 @@ namespace cine2 {
     ind_param agents;
     //ind_param pred;
 
-    static float agents_fitness(const Individual& ind, float cmplx, float penalty)
+    static float agents_fitness(ConstIndividual ind, float cmplx, float penalty)
     {
-      return ind.alive() ? std::max(0.f, ind.food - cmplx * penalty) : 0.0f;
+      return ind.alive() ? std::max(0.f, ind.food() - cmplx * penalty) : 0.0f;
     }
 
     //static float pred_fitness(const Individual& ind, float cmplx, float penalty)
@@ -103,6 +115,9 @@ namespace cine2 {
       float max_item_cap;
 	  float item_growth;
 	  float detection_rate; //*&*
+      Landscape::Occupancy occupancy;   // auto | scatter | convolve
+      Landscape::Layout layout;         // row_major | tiled
+      Regrowth regrowth;                // wheel | sweep
       GaussFilter<3> foragers_kernel;
       GaussFilter<3> klepts_kernel;
     } landscape;
@@ -114,6 +129,29 @@ namespace cine2 {
       std::array<bool, 4> selected;
     } gui;
 
+    struct
+    {
+      int every;            // generations between checkpoints, 0: on SIGTERM only
+      std::string file;     // checkpoint file
+    } checkpoint;
+
+    struct
+    {
+      int threads;          // compression threads of the archive writer, 0: synchronous
+      int pending;          // max. blobs in flight
+      ::archive::codec_param codec;   // codec, level, filter and keyframe interval of the blobs
+    } archive;
+
+    std::string resume;     // checkpoint to resume from
+
+    struct
+    {
+      int every;            // generations between snapshots in <outdir>/replay, 0: none
+      std::string file;     // snapshot of the generation to replay
+    } replay;
+
+    profiler::options profile;    // phase timings, off if neither trace nor summary is given
+
     //std::string init_pred_ann;
     std::string init_agents_ann;
     int initG;
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <omp.h>
+#include "profiler.h"
+
+
+namespace cine2 {
+  namespace profiler {
+
+    const char* phase_names[] = {
+      "timestep",
+      "growth",
+      "growth.thread",
+      "move",
+      "move.thread",
+      "occupancy",
+      "record",
+      "attacks",
+      "foraging",
+      "foraging.thread",
+      "fitness",
+      "analysis",
+      "observer",
+      "new_generation",
+      "checkpoint",
+    };
+    static_assert(sizeof(phase_names) / sizeof(phase_names[0]) == static_cast<size_t>(phase::max_phase), "phase_names out of sync");
+
+
+    namespace detail {
+      std::atomic<bool> enabled{ false };
+    }
+
+
+    namespace {
+
+      struct event
+      {
+        int64_t t0, t1;   // [ns] steady_clock
+        phase p;
+      };
+
+
+      // events of one thread, drained by session::generation
+      struct thread_buffer
+      {
+        std::mutex mutex;
+        std::vector<event> events;
+        int tid;
+        std::string name;
+      };
+
+
+      // buffers of all threads that ever recorded, they live until exit
+      std::mutex registry_mutex;
+      std::vector<std::unique_ptr<thread_buffer>> registry;
+      thread_local thread_buffer* local_buffer = nullptr;
+
+
+      thread_buffer* register_thread()
+      {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.emplace_back(new thread_buffer());
+        auto buf = registry.back().get();
+        buf->tid = static_cast<int>(registry.size());
+        buf->name = omp_in_parallel() ? "omp " + std::to_string(omp_get_thread_num()) : std::string("main");
+        buf->events.reserve(1024);
+        return buf;
+      }
+
+    }
+
+
+    void detail::record(phase p, int64_t t0, int64_t t1)
+    {
+      if (local_buffer == nullptr) local_buffer = register_thread();
+      std::lock_guard<std::mutex> lock(local_buffer->mutex);
+      local_buffer->events.push_back({ t0, t1, p });
+    }
+
+
+    struct session::impl
+    {
+      options opt;
+      std::ofstream trace;
+      std::ofstream summary;
+      int64_t epoch = 0;
+      bool first_event = true;
+      std::vector<bool> named;      // [tid] thread_name emitted
+      std::vector<event> events;
+
+      void trace_event(const char* name, int tid, int64_t t0, int64_t t1, int g)
+      {
+        trace << (first_event ? "" : ",\n");
+        first_event = false;
+        trace << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+              << ",\"ts\":" << 0.001 * (t0 - epoch) << ",\"dur\":" << 0.001 * (t1 - t0)
+              << ",\"args\":{\"g\":" << g << "}}";
+      }
+
+      void thread_name(const thread_buffer& buf)
+      {
+        if (named.size() <= static_cast<size_t>(buf.tid)) named.resize(buf.tid + 1, false);
+        if (named[buf.tid]) return;
+        named[buf.tid] = true;
+        trace << (first_event ? "" : ",\n");
+        first_event = false;
+        trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf.tid
+              << ",\"args\":{\"name\":\"" << buf.name << "\"}}";
+      }
+    };
+
+
+    session::session(const options& opt)
+    {
+      if (opt.trace.empty() && opt.summary.empty()) return;
+      if (detail::enabled.exchange(true)) throw std::runtime_error("profiler: session already active");
+      pimpl_ = new impl();
+      pimpl_->opt = opt;
+      try {
+        if (!opt.trace.empty()) {
+          pimpl_->trace.open(opt.trace);
+          if (!pimpl_->trace.is_open()) throw std::runtime_error("can't create " + opt.trace);
+          pimpl_->trace.precision(3);
+          pimpl_->trace << std::fixed << "[\n";
+        }
+        if (!opt.summary.empty()) {
+          pimpl_->summary.open(opt.summary);
+          if (!pimpl_->summary.is_open()) throw std::runtime_error("can't create " + opt.summary);
+          pimpl_->summary.precision(3);
+          pimpl_->summary << std::fixed << "g\tphase\tcalls\tms\tmax_thread_ms\n";
+        }
+      }
+      catch (...) {
+        delete pimpl_;
+        detail::enabled = false;
+        throw;
+      }
+      if (local_buffer == nullptr) local_buffer = register_thread();    // "main"
+      // drop leftovers of an earlier session
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      for (auto& buf : registry) {
+        std::lock_guard<std::mutex> block(buf->mutex);
+        buf->events.clear();
+      }
+      pimpl_->epoch = detail::now();
+    }
+
+
+    session::~session()
+    {
+      if (pimpl_ == nullptr) return;
+      detail::enabled = false;
+      if (pimpl_->trace.is_open()) pimpl_->trace << "\n]\n";
+      delete pimpl_;
+    }
+
+
+    void session::generation(int g)
+    {
+      if (pimpl_ == nullptr) return;
+      auto& s = *pimpl_;
+      const bool traced = s.trace.is_open() && s.opt.every > 0 && g % s.opt.every == 0;
+      constexpr size_t P = static_cast<size_t>(phase::max_phase);
+      std::array<int64_t, P> calls{}, total{}, max_thread{};
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      for (auto& buf : registry) {
+        s.events.clear();
+        {
+          std::lock_guard<std::mutex> block(buf->mutex);
+          s.events.swap(buf->events);
+        }
+        if (s.events.empty()) continue;
+        std::array<int64_t, P> thread_total{};
+        if (traced) s.thread_name(*buf);
+        for (const auto& e : s.events) {
+          const auto p = static_cast<size_t>(e.p);
+          ++calls[p];
+          thread_total[p] += e.t1 - e.t0;
+          if (traced) s.trace_event(phase_names[p], buf->tid, e.t0, e.t1, g);
+        }
+        for (size_t p = 0; p < P; ++p) {
+          total[p] += thread_total[p];
+          max_thread[p] = std::max(max_thread[p], thread_total[p]);
+        }
+      }
+      if (s.summary.is_open()) {
+        for (size_t p = 0; p < P; ++p) {
+          if (calls[p]) {
+            s.summary << g << '\t' << phase_names[p] << '\t' << calls[p] << '\t' << 1e-6 * total[p] << '\t' << 1e-6 * max_thread[p] << '\n';
+          }
+        }
+        s.summary.flush();
+      }
+      if (traced) s.trace.flush();
+    }
+
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef CINE2_PROFILER_H_INCLUDED
+#define CINE2_PROFILER_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+namespace cine2 {
+
+
+  /// \brief  Scoped phase timer of the simulation hot path.
+  ///
+  /// A profiler::scope records {phase, thread, begin, end} into a buffer
+  /// of the calling thread while a session is active. Once per generation
+  /// the buffers are written out as Chrome trace events (JSON array format,
+  /// loads into chrome://tracing and ui.perfetto.dev) and summed up into a
+  /// per-generation table.
+  /// Without session, a scope costs a relaxed load and a branch; building
+  /// with CINE2_NO_PROFILER removes the scopes altogether.
+  namespace profiler {
+
+    /// \brief  Instrumented phases, see phase_names.
+    /// The *_thread phases are timed per OpenMP thread inside the
+    /// parallel region of the phase.
+    enum class phase : uint8_t {
+      timestep,
+      growth,
+      growth_thread,
+      move,
+      move_thread,
+      occupancy,
+      record,
+      attacks,
+      foraging,
+      foraging_thread,
+      fitness,
+      analysis,
+      observer,
+      new_generation,
+      checkpoint,
+      max_phase
+    };
+
+    extern const char* phase_names[];
+
+
+    struct options
+    {
+      std::string trace;      // Chrome trace file, empty: none
+      std::string summary;    // per-generation table (tab separated), empty: none
+      int every = 1;          // generations between traced generations
+    };
+
+
+    /// \brief  Activates the profiler for its lifetime.
+    ///
+    /// One session at a time, not active if neither trace nor summary
+    /// is requested.
+    class session
+    {
+    public:
+      explicit session(const options& opt);
+      ~session();
+
+      /// \brief  Ends generation g: writes and drops the events recorded since.
+      void generation(int g);
+
+      session(const session&) = delete;
+      session& operator=(const session&) = delete;
+
+    private:
+      struct impl;
+      impl* pimpl_ = nullptr;
+    };
+
+
+    namespace detail {
+
+      extern std::atomic<bool> enabled;
+
+      inline int64_t now()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+
+      void record(phase p, int64_t t0, int64_t t1);
+
+    }
+
+
+#if !defined(CINE2_NO_PROFILER)
+
+    class scope
+    {
+    public:
+      explicit scope(phase p) : t0_(detail::enabled.load(std::memory_order_relaxed) ? detail::now() : 0), p_(p) {}
+      ~scope() { if (t0_) detail::record(p_, t0_, detail::now()); }
+
+      // ends the current phase and starts p, for consecutive phases in one block
+      void next(phase p)
+      {
+        if (t0_) {
+          const int64_t t1 = detail::now();
+          detail::record(p_, t0_, t1);
+          t0_ = t1;
+        }
+        p_ = p;
+      }
+
+      scope(const scope&) = delete;
+      scope& operator=(const scope&) = delete;
+
+    private:
+      int64_t t0_;    // 0: not recording
+      phase p_;
+    };
+
+#else
+
+    class scope
+    {
+    public:
+      explicit scope(phase) {}
+      void next(phase) {}
+    };
+
+#endif
+
+  }
+
+}
+
+#endif
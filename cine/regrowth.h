@@ -0,0 +1,149 @@
+#ifndef CINE2_REGROWTH_H_INCLUDED
+#define CINE2_REGROWTH_H_INCLUDED
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+#include "landscape.h"
+#include "rnd.hpp"
+
+
+namespace cine2 {
+
+
+  /// \brief  Item regrowth strategies.
+  enum class Regrowth : int {
+    wheel = 0,    // ItemRegrowth
+    sweep,        // Bernoulli trial per cell and timestep
+  };
+
+
+  /// \brief  Event-driven item regrowth.
+  ///
+  /// Instead of a Bernoulli trial per cell and timestep, every cell holds
+  /// the time of its next growth event. The waiting times are geometric
+  /// with p = item_growth * capacity, which gives the same process as the
+  /// per-timestep trials. Pending events live in a timing wheel of
+  /// wheel_size buckets; cells with p = 0 are never scheduled. A timestep
+  /// costs O(events + scheduled cells / wheel_size) instead of O(dim^2).
+  ///
+  /// Events of cells at max_items still fire but don't add items.
+  /// The waiting time of a cell only depends on its own random stream,
+  /// keyed by its row-major index: the outcome is independent of the
+  /// processing order, the number of threads and the layer layout.
+  class ItemRegrowth
+  {
+  public:
+    static constexpr int wheel_size = 256;    // POT
+
+    ItemRegrowth() : now_(0) {}
+
+    /// \brief  Schedules the first event of all cells with p > 0.
+    ///
+    /// \param  rs  The streams for the initial draws.
+    void init(const Landscape& landscape, float item_growth, const rnd::streams& rs)
+    {
+      using Layers = Landscape::Layers;
+      const int D = landscape.dim();
+      const LayerView capacity = landscape[Layers::capacity];
+      now_ = 0;
+      item_growth_ = item_growth;
+      due_.assign(size_t(D) * D, never);
+      for (auto& bucket : wheel_) bucket.clear();
+      for (int y = 0; y < D; ++y) {
+        for (int x = 0; x < D; ++x) {
+          const int cell = y * D + x;
+          const float p = item_growth_ * capacity.data()[landscape.index(x, y)];
+          if (p > 0.f) {
+            auto reng = rs(rnd::purpose::item_growth, cell);
+            // first event at now_ + k, k = 0, 1, ...
+            schedule(cell, now_ + waiting_time(p, reng) - 1);
+          }
+        }
+      }
+    }
+
+    /// \brief  Grows the items of the cells due in this timestep,
+    /// advances the clock by one timestep.
+    ///
+    /// \param  rs  The streams of this timestep.
+    void grow(Landscape& landscape, Landscape::item_t max_items, const rnd::streams& rs)
+    {
+      using Layers = Landscape::Layers;
+      const int D = landscape.dim();
+      const LayerView capacity = landscape[Layers::capacity];
+      Landscape::item_t* __restrict items = landscape.items_layer().data();
+      auto& bucket = wheel_[now_ & (wheel_size - 1)];
+      size_t keep = 0;
+      for (size_t k = 0; k < bucket.size(); ++k) {
+        const int cell = bucket[k];
+        if (due_[cell] != now_) {
+          bucket[keep++] = cell;      // a later round of the wheel
+          continue;
+        }
+        const int i = landscape.index(cell % D, cell / D);
+        items[i] = std::min(max_items, static_cast<Landscape::item_t>(items[i] + 1));
+        auto reng = rs(rnd::purpose::item_growth, cell);
+        const uint64_t due = now_ + waiting_time(item_growth_ * capacity.data()[i], reng);
+        if (((due ^ now_) & (wheel_size - 1)) == 0) {
+          due_[cell] = due;
+          bucket[keep++] = cell;
+        }
+        else {
+          schedule(cell, due);
+        }
+      }
+      bucket.resize(keep);
+      ++now_;
+    }
+
+    /// \return timesteps since init.
+    uint64_t now() const { return now_; }
+
+    /// \return the next event of all cells, by row-major index.
+    const std::vector<uint64_t>& due() const { return due_; }
+
+    /// \brief  Restores the state saved from now() and due().
+    ///
+    /// The wheel is rebuilt from due; the order of the cells within a
+    /// bucket doesn't affect the outcome.
+    void restore(float item_growth, uint64_t now, const uint64_t* due, size_t cells)
+    {
+      now_ = now;
+      item_growth_ = item_growth;
+      due_.assign(due, due + cells);
+      for (auto& bucket : wheel_) bucket.clear();
+      for (size_t cell = 0; cell < cells; ++cell) {
+        if (due_[cell] != never) {
+          wheel_[due_[cell] & (wheel_size - 1)].push_back(static_cast<int>(cell));
+        }
+      }
+    }
+
+  private:
+    static constexpr uint64_t never = std::numeric_limits<uint64_t>::max();
+
+    // geometric waiting time >= 1, P(k) = (1 - p)^(k - 1) * p
+    template <typename URNG>
+    static uint64_t waiting_time(float p, URNG& reng)
+    {
+      return 1 + rndutils::geometric_skip(p, reng);
+    }
+
+    void schedule(int cell, uint64_t due)
+    {
+      due_[cell] = due;
+      wheel_[due & (wheel_size - 1)].push_back(cell);
+    }
+
+    uint64_t now_;                                      // timesteps since init
+    float item_growth_ = 0.f;
+    std::vector<uint64_t> due_;                         // [row-major cell] next event
+    std::array<std::vector<int>, wheel_size> wheel_;    // cells by due % wheel_size
+  };
+
+}
+
+#endif
@@ -7,6 +7,41 @@
 namespace rnd {
 
   extern rndutils::default_engine thread_local reng;
+
+
+  // What the random numbers of a stream are used for.
+  // Part of the stream key, don't reorder.
+  enum class purpose : unsigned {
+    init_position,
+    init_ann,
+    item_growth,
+    move,
+    attack,
+    conflict,
+    forage,
+    reproduce,
+    mutate,
+  };
+
+
+  using stream_engine = rndutils::philox4x32;
+
+
+  // Counter-based random streams at one point (generation, timestep) of a
+  // seeded run. operator() returns the stream for (purpose, index), e.g.
+  // the agent index; it's the same on every thread and for any thread count.
+  struct streams
+  {
+    uint64_t seed;
+    int generation;
+    int timestep;
+
+    stream_engine operator()(purpose p, int index) const
+    {
+      return rndutils::make_keyed_engine(seed, generation, timestep, index, static_cast<unsigned>(p));
+    }
+  };
+
 }
 
 #endif
@@ -26,6 +26,8 @@
 #include <initializer_list>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
+#include <limits>
 #include <istream>
 #include <iosfwd>
 
@@ -483,6 +485,302 @@ private:
 };
 
 
+// Philox4x32-10 counter-based random number generator
+// (Salmon et al. 2011, "Parallel random numbers: as easy as 1, 2, 3").
+// The output is a pure function of (key, counter): every counter value
+// names an independent stream that yields the same numbers no matter
+// which thread draws them or in which order the streams are visited.
+// counter[0] is the running block counter, counter[1..3] are free for
+// the caller to name the stream. 64bit result, crush-resistant.
+class philox4x32
+{
+public:
+  using result_type = uint64_t;
+  using engine_type = philox4x32;
+  using key_type = std::array<uint32_t, 2>;
+  using counter_type = std::array<uint32_t, 4>;
+
+  static constexpr uint64_t default_seed = static_cast<uint64_t>(0x9e3779b97f4a7c15);
+  static constexpr uint64_t(min)() { return static_cast<uint64_t>(0); };
+  static constexpr uint64_t(max)() { return static_cast<uint64_t>(-1); };
+
+  explicit philox4x32(uint64_t val = default_seed)
+  {
+    seed(val);
+  }
+
+  philox4x32(key_type key, counter_type ctr) : key_(key), ctr_(ctr), idx_(2)
+  {
+  }
+
+  void seed(uint64_t val = default_seed)
+  {
+    key_ = { { static_cast<uint32_t>(val), static_cast<uint32_t>(val >> 32) } };
+    ctr_ = { { 0, 0, 0, 0 } };
+    idx_ = 2;
+  }
+
+  uint64_t operator()(void)
+  {
+    if (idx_ == 2) {
+      block_ = bijection(ctr_, key_);
+      ++ctr_[0];
+      idx_ = 0;
+    }
+    const auto i = 2 * idx_++;
+    return (static_cast<uint64_t>(block_[i + 1]) << 32) | block_[i];
+  }
+
+  void discard(unsigned long long z)
+  {
+    for (; z && idx_ != 2; --z) ++idx_;
+    ctr_[0] += static_cast<uint32_t>(z / 2);
+    if (z & 1) this->operator()();
+  }
+
+  // the keyed bijection: ten rounds of Philox4x32
+  static counter_type bijection(counter_type ctr, key_type key)
+  {
+    for (int r = 0; r < 10; ++r) {
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53) * ctr[0];
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57) * ctr[2];
+      ctr = { { static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(p0) } };
+      key[0] += 0x9E3779B9;
+      key[1] += 0xBB67AE85;
+    }
+    return ctr;
+  }
+
+  // Fills dst[0, n) with the 32bit words of the next (n + 3) / 4 blocks,
+  // in the order operator() returns them as low and high halves.
+  // A partially consumed block is skipped. Up to 16 blocks are computed
+  // side by side, the rounds vectorize across the blocks.
+  void generate(uint32_t* dst, size_t n)
+  {
+    constexpr int lanes = 16;
+    while (n) {
+      alignas(64) uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+#     pragma omp simd
+      for (int l = 0; l < lanes; ++l) {
+        c0[l] = ctr_[0] + static_cast<uint32_t>(l); c1[l] = ctr_[1]; c2[l] = ctr_[2]; c3[l] = ctr_[3];
+      }
+      uint32_t k0 = key_[0], k1 = key_[1];
+      for (int r = 0; r < 10; ++r) {
+#       pragma omp simd
+        for (int l = 0; l < lanes; ++l) {
+          const uint64_t p0 = static_cast<uint64_t>(0xD2511F53) * c0[l];
+          const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57) * c2[l];
+          c0[l] = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+          c1[l] = static_cast<uint32_t>(p1);
+          c2[l] = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+          c3[l] = static_cast<uint32_t>(p0);
+        }
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+      }
+      const size_t m = std::min(n, size_t(4 * lanes));
+      for (size_t i = 0; i < m; ++i) {
+        const size_t l = i >> 2;
+        switch (i & 3) {
+          case 0: dst[i] = c0[l]; break;
+          case 1: dst[i] = c1[l]; break;
+          case 2: dst[i] = c2[l]; break;
+          default: dst[i] = c3[l]; break;
+        }
+      }
+      ctr_[0] += static_cast<uint32_t>((m + 3) / 4);
+      dst += m;
+      n -= m;
+    }
+    idx_ = 2;
+  }
+
+  const key_type& key() const { return key_; }
+  const counter_type& counter() const { return ctr_; }
+
+  friend bool operator==(engine_type const& lhs, engine_type const& rhs)
+  {
+    return lhs.key_ == rhs.key_ && lhs.ctr_ == rhs.ctr_ && lhs.idx_ == rhs.idx_ && (lhs.idx_ == 2 || lhs.block_ == rhs.block_);
+  }
+
+  friend bool operator!=(engine_type const& lhs, engine_type const& rhs)
+  {
+    return !(lhs == rhs);
+  }
+
+  template <class CharT, class Traits>
+  friend auto operator<<(std::basic_ostream<CharT, Traits>& os, engine_type const& reng) -> std::basic_ostream<CharT, Traits>&
+  {
+    for (auto x : reng.key_) os << x << ' ';
+    for (auto x : reng.ctr_) os << x << ' ';
+    os << reng.idx_ << ' ';
+    return os;
+  }
+
+  template <class CharT, class Traits>
+  friend auto operator>>(std::basic_istream<CharT, Traits>& is, engine_type& reng) -> std::basic_istream<CharT, Traits>&
+  {
+    for (auto& x : reng.key_) is >> x >> std::ws;
+    for (auto& x : reng.ctr_) is >> x >> std::ws;
+    is >> reng.idx_ >> std::ws;
+    if (reng.idx_ != 2) {
+      --reng.ctr_[0];
+      reng.block_ = bijection(reng.ctr_, reng.key_);
+      ++reng.ctr_[0];
+    }
+    return is;
+  }
+
+private:
+  key_type key_;
+  counter_type ctr_;
+  counter_type block_;
+  int idx_;
+};
+
+
+// Philox stream keyed by (seed, generation, timestep, index, purpose).
+// Streams with different keys are independent. The generation is taken
+// modulo 2^24 and purpose shall be < 256.
+inline philox4x32 make_keyed_engine(uint64_t seed, int generation, int timestep, int index, unsigned purpose)
+{
+  assert(purpose < 256 && "purpose out of range in make_keyed_engine");
+  return philox4x32(
+    { { static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) } },
+    { { 0u, static_cast<uint32_t>(index), static_cast<uint32_t>(timestep),
+        (static_cast<uint32_t>(generation) & 0x00ffffffu) | (purpose << 24) } });
+}
+
+
+// Number of failures before the first success in Bernoulli(p) trials,
+// i.e. the gap to the next hit when skipping through sparse events.
+// Returns 0 for p >= 1 and 2^62 ('never') for p <= 0.
+template <typename URNG>
+inline uint64_t geometric_skip(double p, URNG& reng)
+{
+  constexpr uint64_t never = uint64_t(1) << 62;
+  if (p >= 1.0) return 0;
+  if (p <= 0.0) return never;
+  const double u = 1.0 - std::uniform_real_distribution<double>()(reng);   // (0, 1]
+  const double k = std::floor(std::log(u) / std::log1p(-p));
+  return (k < double(never)) ? static_cast<uint64_t>(k) : never;
+}
+
+
+//
+// Batched generation
+//
+// Fill caller provided buffers with n variates at once: the kernels
+// consume blocks of random numbers instead of paying for a distribution
+// call per scalar. The transforms run in simd loops over chunks of raw
+// 32bit words; 64 byte aligned buffers help. Floats carry 24 random bits,
+// Bernoulli probabilities are resolved to 2^-32.
+// The results differ from the <random> distributions drawn one by one.
+
+
+// raw 32bit words from any 64bit engine
+template <typename URNG>
+inline void generate_bits(URNG& reng, uint32_t* dst, size_t n)
+{
+  static_assert((URNG::min)() == 0 && (URNG::max)() == std::numeric_limits<uint64_t>::max(), "generate_bits requires a 64bit engine");
+  for (size_t i = 0; i + 1 < n; i += 2) {
+    const uint64_t x = reng();
+    dst[i] = static_cast<uint32_t>(x);
+    dst[i + 1] = static_cast<uint32_t>(x >> 32);
+  }
+  if (n & 1) dst[n - 1] = static_cast<uint32_t>(reng());
+}
+
+
+inline void generate_bits(philox4x32& reng, uint32_t* dst, size_t n)
+{
+  reng.generate(dst, n);
+}
+
+
+namespace detail {
+
+  constexpr size_t batch_chunk = 256;
+
+  // calls fun(bits, offset, m) for chunks of m <= batch_chunk raw words
+  template <typename URNG, typename Fun>
+  inline void for_each_bits_chunk(URNG& reng, size_t n, Fun&& fun)
+  {
+    alignas(64) uint32_t bits[batch_chunk];
+    for (size_t i = 0; i < n; i += batch_chunk) {
+      const size_t m = std::min(batch_chunk, n - i);
+      generate_bits(reng, bits, m);
+      fun(bits, i, m);
+    }
+  }
+
+  // [0, 1)
+  inline float bits_to_float01(uint32_t x) { return static_cast<float>(x >> 8) * (1.0f / 16777216.0f); }
+
+  // (0, 1)
+  inline float bits_to_float_open(uint32_t x) { return (static_cast<float>(x >> 8) + 0.5f) * (1.0f / 16777216.0f); }
+
+}
+
+
+// dst[i] uniform in [a, b)
+template <typename URNG>
+inline void generate_uniform(URNG& reng, float* dst, size_t n, float a = 0.f, float b = 1.f)
+{
+  const float range = b - a;
+  detail::for_each_bits_chunk(reng, n, [=](const uint32_t* __restrict bits, size_t i, size_t m) {
+    float* __restrict d = dst + i;
+#   pragma omp simd
+    for (size_t j = 0; j < m; ++j) d[j] = a + range * detail::bits_to_float01(bits[j]);
+  });
+}
+
+
+// mask[i] = 1 with probability p, 0 otherwise
+template <typename URNG>
+inline void generate_bernoulli(URNG& reng, uint8_t* mask, size_t n, double p)
+{
+  const uint64_t threshold = (p <= 0.0) ? 0 : (p >= 1.0) ? (uint64_t(1) << 32) : static_cast<uint64_t>(p * 4294967296.0);
+  detail::for_each_bits_chunk(reng, n, [=](const uint32_t* __restrict bits, size_t i, size_t m) {
+    uint8_t* __restrict d = mask + i;
+#   pragma omp simd
+    for (size_t j = 0; j < m; ++j) d[j] = static_cast<uint64_t>(bits[j]) < threshold ? 1 : 0;
+  });
+}
+
+
+// dst[i] normal(mean, stddev), Box-Muller on pairs
+template <typename URNG>
+inline void generate_normal(URNG& reng, float* dst, size_t n, float mean = 0.f, float stddev = 1.f)
+{
+  const size_t n2 = (n + 1) & ~size_t(1);
+  detail::for_each_bits_chunk(reng, n2, [=](const uint32_t* __restrict bits, size_t i, size_t m) {
+    alignas(64) float z[detail::batch_chunk];
+#   pragma omp simd
+    for (size_t j = 0; j < m / 2; ++j) {
+      const float r = std::sqrt(-2.0f * std::log(detail::bits_to_float_open(bits[2 * j])));
+      const float phi = 6.2831853f * detail::bits_to_float01(bits[2 * j + 1]);
+      z[2 * j] = mean + stddev * r * std::cos(phi);
+      z[2 * j + 1] = mean + stddev * r * std::sin(phi);
+    }
+    std::copy_n(z, std::min(m, n - i), dst + i);
+  });
+}
+
+
+// dst[i] cauchy(a, b)
+template <typename URNG>
+inline void generate_cauchy(URNG& reng, float* dst, size_t n, float a = 0.f, float b = 1.f)
+{
+  detail::for_each_bits_chunk(reng, n, [=](const uint32_t* __restrict bits, size_t i, size_t m) {
+    float* __restrict d = dst + i;
+#   pragma omp simd
+    for (size_t j = 0; j < m; ++j) d[j] = a + b * std::tan(3.14159265f * (detail::bits_to_float_open(bits[j]) - 0.5f));
+  });
+}
+
+
 //
 // Seeding support
 //
@@ -1118,11 +1416,179 @@ private:
 };
 
 
+// Walker's alias method in Vose's formulation: O(1) sampling from
+// a discrete distribution with O(n) construction. Use it instead of
+// mutable_discrete_distribution if the weights change as a whole between
+// many draws. Sampling requires a 64bit engine, one draw per variate.
+// The scaling of the weights runs in parallel under OpenMP; the pairing
+// of the columns is a linear sweep in index order, hence the table
+// doesn't depend on the number of threads.
+template <typename IntType = int,
+          typename AllZeroPolicy = all_zero_policy_throw
+>
+class alias_distribution
+{
+public:
+  using distribution_type = alias_distribution;
+  using result_type = IntType;
+
+  static_assert(std::is_integral<result_type>::value,
+                "Invalid template argument for alias_distribution");
+
+  result_type min() const
+  {
+    return result_type(0);
+  }
+  result_type max() const
+  {
+    return static_cast<result_type>(alias_.size() - 1);
+  }
+
+  alias_distribution()
+  : threshold_(1, full), alias_(1, result_type(0))
+  { // default ctor
+  }
+
+  template <typename RndIt>
+  alias_distribution(RndIt first, RndIt last)
+  {
+    mutate(first, last);
+  }
+
+  size_t size() const { return alias_.size(); }
+
+  void reset()
+  {
+  }
+
+  template <typename Reng>
+  result_type operator()(Reng& reng) const
+  {
+    static_assert((Reng::min)() == 0 && (Reng::max)() == std::numeric_limits<uint64_t>::max(), "alias_distribution requires a 64bit engine");
+    const uint64_t x = reng();
+    const uint64_t i = ((x >> 32) * alias_.size()) >> 32;    // column
+    return (static_cast<uint32_t>(x) < threshold_[i]) ? static_cast<result_type>(i) : alias_[i];
+  }
+
+  // rebuilds the table from the weights [first, last)
+  template <typename RndIt>
+  void mutate(RndIt first, RndIt last)
+  {
+    const auto n = static_cast<std::ptrdiff_t>(std::distance(first, last));
+    if (n == 0) {
+      threshold_.assign(1, full);
+      alias_.assign(1, result_type(0));
+      return;
+    }
+    q_.resize(n);
+    threshold_.resize(n);
+    alias_.resize(n);
+    double sum = 0.0;
+    for (std::ptrdiff_t i = 0; i < n; ++i) {
+      assert(first[i] >= 0 && "Negative weight in alias_distribution");
+      sum += static_cast<double>(first[i]);
+    }
+    if (!apply_all_zero_policy(sum, AllZeroPolicy{})) {
+      // uniform
+      std::fill(threshold_.begin(), threshold_.end(), full);
+      for (std::ptrdiff_t i = 0; i < n; ++i) alias_[i] = static_cast<result_type>(i);
+      return;
+    }
+    // scaled weights, mean 1
+    const double scale = static_cast<double>(n) / sum;
+#   pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t i = 0; i < n; ++i) {
+      q_[i] = scale * static_cast<double>(first[i]);
+      threshold_[i] = full;
+      alias_[i] = static_cast<result_type>(i);
+    }
+    small_.clear();
+    large_.clear();
+    for (std::ptrdiff_t i = 0; i < n; ++i) {
+      (q_[i] < 1.0 ? small_ : large_).push_back(static_cast<result_type>(i));
+    }
+    while (!small_.empty() && !large_.empty()) {
+      const auto s = small_.back(); small_.pop_back();
+      const auto l = large_.back();
+      threshold_[s] = static_cast<uint32_t>(q_[s] * 4294967296.0);
+      alias_[s] = l;
+      q_[l] = (q_[l] + q_[s]) - 1.0;
+      if (q_[l] < 1.0) {
+        large_.pop_back();
+        small_.push_back(l);
+      }
+    }
+    // leftovers are full columns up to rounding
+  }
+
+  template <typename W>
+  void mutate(W const& w)
+  {
+    mutate(w.cbegin(), w.cend());
+  }
+
+private:
+  static constexpr uint32_t full = std::numeric_limits<uint32_t>::max();
+
+  // returns false if the weights shall be treated as uniform
+  static bool apply_all_zero_policy(double sum, all_zero_policy_throw)
+  { // throw
+    if (sum <= 0.0) {
+      throw std::invalid_argument("Invalid weight-vector for alias_distribution");
+    }
+    return true;
+  }
+
+  static bool apply_all_zero_policy(double sum, all_zero_policy_assert)
+  { // assert
+    assert(sum > 0.0 && "Invalid weight-vector for alias_distribution");
+    return true;
+  }
+
+  static bool apply_all_zero_policy(double sum, all_zero_policy_uni)
+  { // degenerate to uniform distribution
+    return sum > 0.0;
+  }
+
+  std::vector<uint32_t> threshold_;       // keep column i if low 32 bits < threshold_[i]
+  std::vector<result_type> alias_;        // the other index in column i
+  std::vector<double> q_;                 // scratch: scaled weights
+  std::vector<result_type> small_;        // scratch: columns below 1
+  std::vector<result_type> large_;        // scratch: columns above 1
+};
+
+
 //
 // Algorithms
 //
 
 
+// Systematic (stochastic universal) sampling of n indices from the
+// weights [first, last): one uniform offset, n equally spaced pointers.
+// Index i is drawn floor or ceil of n * w_i / sum(w) times, the indices
+// are written in ascending order. Uniform if all weights are zero.
+template <typename RndIt, typename OIt, typename URNG>
+void systematic_sample(RndIt first, RndIt last, size_t n, URNG& reng, OIt out)
+{
+  const auto N = static_cast<size_t>(std::distance(first, last));
+  if (N == 0 || n == 0) return;
+  double sum = 0.0;
+  for (size_t i = 0; i < N; ++i) sum += static_cast<double>(first[i]);
+  const bool uni = !(sum > 0.0);
+  const double step = (uni ? double(N) : sum) / double(n);
+  double ptr = step * uniform01<double>(reng);
+  double cum = uni ? 1.0 : static_cast<double>(first[0]);
+  size_t i = 0;
+  for (size_t k = 0; k < n; ++k, ptr += step) {
+    while (ptr >= cum && i + 1 < N) {
+      ++i;
+      cum += uni ? 1.0 : static_cast<double>(first[i]);
+    }
+    *out++ = i;
+  }
+}
+
+
 template <typename OIt, typename URNG>
 void generate_uniform_n(size_t n, URNG& reng, OIt out)
 {
@@ -1194,6 +1660,7 @@ inline void shuffle_n(RndIt first, RndIt last, SizeT n, URNG&& reng)
 namespace std {
   RNDUTILS_FAST_GENERATE_CANONICAL(rndutils::xorshift128)
   RNDUTILS_FAST_GENERATE_CANONICAL(rndutils::xorshift1024)
+  RNDUTILS_FAST_GENERATE_CANONICAL(rndutils::philox4x32)
 }
 #endif
 
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <filesystem>
 #include "simulation.h"
+#include "checkpoint.h"
+#include "profiler.h"
 #include "game_watches.hpp"
 #include "cmd_line.h"
 #include "cassert"
@@ -14,12 +16,13 @@ namespace cine2 {
 
   Simulation::Simulation(const Param& param)
     : g_(-1), t_(-1),
+    g0_(0), t0_(0),
     param_(param)
   {
     using Layers = Landscape::Layers;
 
-    agents_.pop = std::vector<Individual>(param.agents.N);
-    agents_.tmp_pop = std::vector<Individual>(param.agents.N);
+    agents_.pop = Individuals(param.agents.N);
+    agents_.tmp_pop = Individuals(param.agents.N);
     agents_.ann = make_any_ann(param.agents.L, param.agents.N, param.agents.ann.c_str());
     agents_.fitness = std::vector<float>(param.agents.N, 0.f);
     agents_.foraged = std::vector<float>(param.agents.N, 0);
@@ -27,25 +30,34 @@ namespace cine2 {
     agents_.conflicts = 0;
     agents_.tmp_ann = make_any_ann(param.agents.L, param.agents.N, param.agents.ann.c_str());
 
-    shuffle_vec.resize(param.agents.N);
-    std::iota(shuffle_vec.begin(), shuffle_vec.end(), 0);
-
-    agents_.ann->initialize(param.agents);
+    const auto rs = streams(-param.Gburnin - 1, 0);
+    agents_.ann->initialize(param.agents, rs);
 
     // initial landscape layers from image fies
     // CAPACITY NOW REFERS TO REGROWTH RATE
     init_layer(param_.landscape.capacity); //capacity
     if (landscape_.dim() < 32) throw std::runtime_error("Landscape too small");
+    landscape_.occupancy(param.landscape.occupancy);
 
     // full grass cover
     //for (auto& g : landscape_[Layers::items]) g = param.landscape.max_grass_cover;
     const int DD = landscape_.dim() * landscape_.dim();
-    float* __restrict items = landscape_[Layers::items].data();
+    Landscape::item_t* __restrict items = landscape_.items_layer().data();
     float* __restrict capacity = landscape_[Layers::capacity].data();
     for (int i = 0; i < DD; ++i) {
 
-      items[i] = floor(capacity[i] * param.landscape.max_item_cap);
+      items[i] = static_cast<Landscape::item_t>(floor(capacity[i] * param.landscape.max_item_cap));
+
+    }
+
+    // detection probability by item count
+    const float detection_rate = param.landscape.detection_rate;
+    for (int n = 0; n <= static_cast<int>(floor(param.landscape.max_item_cap)); ++n) {
+      detection_prob_.push_back(1.0 - pow((1.0f - detection_rate), static_cast<float>(n)));
+    }
 
+    if (param.landscape.regrowth == Regrowth::wheel) {
+      regrowth_.init(landscape_, param.landscape.item_growth, rs);
     }
 
     //empty grass cover
@@ -53,29 +65,48 @@ namespace cine2 {
 
     // initial positions
     auto coorDist = std::uniform_int_distribution<short>(0, short(landscape_.dim() - 1));
-    for (auto& p : agents_.pop) { p.pos.x = coorDist(rnd::reng); p.pos.y = coorDist(rnd::reng); }
+    auto reng = rs(rnd::purpose::init_position, 0);
+    for (int i = 0; i < agents_.pop.size(); ++i) { auto& pos = agents_.pop.pos()[i]; pos.x = coorDist(reng); pos.y = coorDist(reng); }
 
     // initial occupancies and observable densities
     landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count,
-      Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop.cbegin(), agents_.pop.cend(), param_.landscape.foragers_kernel);
+      Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop, param_.landscape.foragers_kernel);
 
     // optional: initialization from former runs
     if (!param_.init_agents_ann.empty()) {
-      init_anns_from_archive(agents_, archive::iarch(param_.init_agents_ann));
+      archive::iarch ia(param_.init_agents_ann);
+      init_anns_from_archive(agents_, ia);
     }
     //if (!param_.init_pred_ann.empty()) {
     //  init_anns_from_archive(pred_, archive::iarch(param_.init_pred_ann));
     //}
+
+    // optional: complete state from a checkpoint or replay snapshot
+    if (!param_.resume.empty()) {
+      restore_checkpoint(param_.resume);
+    }
+    else if (!param_.replay.file.empty()) {
+      restore_checkpoint(param_.replay.file);
+    }
+  }
+
+
+  std::string Simulation::replay_snapshot(int g) const
+  {
+    const auto dir = filesystem::path(param_.outdir) / "replay";
+    filesystem::create_directories(dir);
+    return (dir / (std::to_string(g) + ".bin")).string();
   }
 
 
   void Simulation::init_anns_from_archive(Population& Pop, archive::iarch& ia)
   {
-    auto cm = ia.extract(param_.initG >= 0 ? std::min(param_.initG, param_.G - 1) : param_.G - 1);
-    if (cm.un != Pop.ann->N()) throw cmd::parse_error("Number of ANNs doesn't match");
-    if (cm.usize != Pop.ann->type_size()) throw cmd::parse_error("ANN state size doesn't match");
+    const size_t idx = param_.initG >= 0 ? std::min(param_.initG, param_.G - 1) : param_.G - 1;
+    const auto& e = ia.entry(idx);
+    if (e.un != Pop.ann->N()) throw cmd::parse_error("Number of ANNs doesn't match");
+    if (e.usize != Pop.ann->type_size()) throw cmd::parse_error("ANN state size doesn't match");
     auto dst = Pop.ann->data();
-    uncompress(dst, cm, Pop.ann->stride() * sizeof(float));
+    ia.decode(idx, dst, Pop.ann->stride() * sizeof(float));
   }
 
 
@@ -91,23 +122,34 @@ namespace cine2 {
       const auto& pop = population.pop;
       const auto& ann = population.ann;
       auto& fitness = population.fitness;
-      const int N = static_cast<int>(pop.size());
+      const int N = pop.size();
 #     pragma omp parallel for schedule(static)
       for (int i = 0; i < N; ++i) {
         fitness[i] = fitness_fun(pop[i], ann->complexity(i), cmplx_penalty);
       }
-      population.rdist.mutate(fitness.cbegin(), fitness.cend());
+      if (iparam.reproduction == Reproduction::alias) {
+        population.rdist.mutate(fitness.cbegin(), fitness.cend());
+      }
     }
 
 
     void create_new_generation(const Landscape& landscape,
       Population& population,
       const Param::ind_param& iparam,
-      bool fixed)
+      bool fixed,
+      const rnd::streams& rs)
     {
       const auto& pop = population.pop;
       const auto& ann = *population.ann;
       const int N = static_cast<int>(pop.size());
+      const bool systematic = (iparam.reproduction == Reproduction::systematic);
+      if (systematic) {
+        // sorted ancestors: the ann copies below run through memory
+        auto& ancestors = population.ancestors;
+        ancestors.clear();
+        auto reng = rs(rnd::purpose::reproduce, N);
+        rndutils::systematic_sample(population.fitness.cbegin(), population.fitness.cend(), N, reng, std::back_inserter(ancestors));
+      }
 #     pragma omp parallel 
       {
         auto& tmp_pop = population.tmp_pop;
@@ -116,13 +158,14 @@ namespace cine2 {
         const auto coorDist = rndutils::uniform_signed_distribution<short>(-iparam.sprout_radius, iparam.sprout_radius);
 #       pragma omp for schedule(static)
         for (int i = 0; i < N; ++i) {
-          const int ancestor = rdist(rnd::reng);
-          auto newPos = pop[ancestor].pos + Coordinate{ coorDist(rnd::reng), coorDist(rnd::reng) };
+          auto reng = rs(rnd::purpose::reproduce, i);
+          const int ancestor = systematic ? population.ancestors[i] : rdist(reng);
+          auto newPos = pop.pos()[ancestor] + Coordinate{ coorDist(reng), coorDist(reng) };
           tmp_pop[i].sprout(landscape.wrap(newPos), ancestor);
           tmp_ann.assign(ann, ancestor, i);   // copy ann
         }
       }
-      population.tmp_ann->mutate(iparam, fixed);
+      population.tmp_ann->mutate(iparam, fixed, rs);
 
       population.conflicts = 0;
 
@@ -149,12 +192,10 @@ namespace cine2 {
       auto& foraged = population.foraged;
       auto& handled = population.handled;
 
-      const int N = static_cast<int>(pop.size());
+      const int N = pop.size();
 
-      for (int i = 0; i < N; ++i) {
-        foraged[i] = pop[i].forage_count;
-        handled[i] = pop[i].handle_count;
-      }
+      std::copy_n(pop.forage_count(), N, foraged.begin());
+      std::copy_n(pop.handle_count(), N, handled.begin());
     }
 
   }
@@ -166,13 +207,18 @@ namespace cine2 {
 
   bool Simulation::run(Observer* observer)
   {
+    SigtermGuard sigterm;
+    profiler::session profile(param_.profile);
+
     // burn-in
     simulation_observer_notify(INITIALIZED);
-    const int Gb = param_.Gburnin;
+    const bool replay = !param_.replay.file.empty();
+    const bool restored = replay || !param_.resume.empty();
+    const int Gb = restored ? 0 : param_.Gburnin;
     for (int gb = 0; gb < Gb; ++gb) {
       const int Tb = param_.T;
       for (int tb = 0; tb < Tb; ++tb) {
-        simulate_timestep(tb);
+        simulate_timestep(gb - Gb, tb);
 
         simulation_observer_notify(WATCHDOG);   // app alive?
       }
@@ -181,33 +227,51 @@ namespace cine2 {
       // clear fitness
       agents_.fitness.assign(agents_.fitness.size(), 0.f);
 
-      assess_fitness(); //CN: fix?
-      create_new_generations();
+      {
+        profiler::scope prof(profiler::phase::fitness);
+        assess_fitness(); //CN: fix?
+      }
+      create_new_generations(gb - Gb);
+      profile.generation(gb - Gb);
     }
-    const int G = param_.G;
+    const int G = replay ? g0_ + 1 : param_.G;    // replay: the restored generation only
 
 
 
-    for (g_ = 0; g_ < G; ++g_) {
+    for (g_ = g0_; g_ < G; ++g_) {
+      const int every_replay = param_.replay.every;
+      if (!replay && every_replay && g_ % every_replay == 0 && (g_ != g0_ || t0_ == 0)) {
+        save_checkpoint(replay_snapshot(g_), g_, 0);
+      }
       simulation_observer_notify(NEW_GENERATION);
       const int T = fixed() ? param_.Tfix : param_.T;
-      for (t_ = 0; t_ < T; ++t_) {
-        simulate_timestep(t_);
-        simulation_observer_notify(POST_TIMESTEP);
+      for (t_ = (g_ == g0_) ? t0_ : 0; t_ < T; ++t_) {
+        simulate_timestep(g_, t_);
+        {
+          profiler::scope prof(profiler::phase::observer);
+          simulation_observer_notify(POST_TIMESTEP);
+        }
+        if (sigterm.raised()) {
+          if (!replay) {
+            simulation_observer_notify(CHECKPOINT);
+            save_checkpoint(param_.checkpoint.file, g_, t_ + 1);
+          }
+          return false;
+        }
         
         
         
         // to print one screenshot
         // print first 150 gens and then every 25 gens
-        if ( ((g_ % 25 == 0) | (g_ <= 150) ) && t_ == 50) {
+        if (!param_.outdir.empty() && ((g_ % 25 == 0) | (g_ <= 150) ) && t_ == 50) {
 
            const std::string strGen_tmp = std::to_string(g_);
            const std::string strGen = std::string(5 - strGen_tmp.length(), '0') + strGen_tmp;
            Image screenshot3(std::string("../settings/emptyPNG.png"));
-           layer_to_image_channel(screenshot3, landscape_[Landscape::Layers::foragers_count], blue);
-           layer_to_image_channel(screenshot3, landscape_[Landscape::Layers::klepts_count], red);
-           layer_to_image_channel(screenshot3, landscape_[Landscape::Layers::handlers_count], green);
-           layer_to_image_channel_2(screenshot3, (landscape_[Landscape::Layers::items]), alha, static_cast<float>(param_.landscape.max_item_cap));
+           layer_to_image_channel(screenshot3, landscape_.as_float(Landscape::Layers::foragers_count), blue);
+           layer_to_image_channel(screenshot3, landscape_.as_float(Landscape::Layers::klepts_count), red);
+           layer_to_image_channel(screenshot3, landscape_.as_float(Landscape::Layers::handlers_count), green);
+           layer_to_image_channel_2(screenshot3, landscape_.as_float(Landscape::Layers::items), alha, static_cast<float>(param_.landscape.max_item_cap));
            //layer_to_image_channel(screenshot2, landscape_[Landscape::Layers::items], alha);
            save_image(screenshot3, std::string(param_.outdir + "/" + strGen + ".png"));
 
@@ -248,11 +312,28 @@ namespace cine2 {
         //writeoutcapacity.close();
       }
 
-      assess_fitness();
-      assess_inds();
-      analysis_.generation(this);
-      simulation_observer_notify(GENERATION);
-      create_new_generations();
+      {
+        profiler::scope prof(profiler::phase::fitness);
+        assess_fitness();
+        assess_inds();
+      }
+      {
+        profiler::scope prof(profiler::phase::analysis);
+        analysis_.generation(this);
+      }
+      {
+        profiler::scope prof(profiler::phase::observer);
+        simulation_observer_notify(GENERATION);
+      }
+      create_new_generations(g_);
+      const int every = param_.checkpoint.every;
+      if (!replay && (sigterm.raised() || (every && (g_ + 1) % every == 0 && g_ + 1 < G))) {
+        profiler::scope prof(profiler::phase::checkpoint);
+        simulation_observer_notify(CHECKPOINT);
+        save_checkpoint(param_.checkpoint.file, g_ + 1, 0);
+      }
+      profile.generation(g_);
+      if (sigterm.raised()) return false;
     }
 
 
@@ -264,34 +345,30 @@ namespace cine2 {
 #undef simulation_observer_notify
 
 
-  void Simulation::simulate_timestep(const int t)
+  void Simulation::simulate_timestep(const int g, const int t)
   {
     using Layers = Landscape::Layers;
+    const auto rs = streams(g, t);
+    profiler::scope prof(profiler::phase::timestep);
 
     // grass growth
-    const int DD = landscape_.dim() * landscape_.dim();
-    float* __restrict items = landscape_[Layers::items].data();					//items now refers to the layer of food items (in landscape)
-    float* __restrict capacity = landscape_[Layers::capacity].data();			//capacity refers to the maximum capacity layer (in landscape)
-    ann_assume_aligned(items, 32);
-    const float max_item_cap = param_.landscape.max_item_cap;
-    const float item_growth = param_.landscape.item_growth;
-    //#   pragma omp parallel for schedule(static)
+    grow_items(rs);
 
-    for (int i = 0; i < DD; ++i) {
-      if (std::bernoulli_distribution(item_growth * capacity[i])(rnd::reng) ) {  // altered: probability that items drop, && capacity[i] > 0.2
-        items[i] = std::min(floor(max_item_cap), floor(items[i] + 1.0f));
-      }
-    }
 
 
-
-    //landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop.cbegin(), agents_.pop.cend(), param_.landscape.foragers_kernel);
+    //landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop, param_.landscape.foragers_kernel);
 
     // move
-    agents_.ann->move(landscape_, agents_.pop, param_.agents);
+    {
+      profiler::scope prof(profiler::phase::move);
+      agents_.ann->move(landscape_, agents_.pop, param_.agents, rs);
+    }
 
     // update occupancies and observable densities
-    landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop.cbegin(), agents_.pop.cend(), param_.landscape.foragers_kernel);
+    {
+      profiler::scope prof(profiler::phase::occupancy);
+      landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop, param_.landscape.foragers_kernel);
+    }
 
     if (t == param_.T / 2) {
       LayerView foragers_intake = landscape_[Landscape::Layers::foragers_intake];
@@ -301,33 +378,71 @@ namespace cine2 {
     }
 
     if ( t >= param_.T / 2) {
+      profiler::scope prof(profiler::phase::record);
       update_landscaperecord();
 
     }
 
 
     //RESOLVE GRAZING AND ATTACK function!
-    resolve_grazing_and_attacks();
+    resolve_grazing_and_attacks(rs);
 
 
-    landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop.cbegin(), agents_.pop.cend(), param_.landscape.foragers_kernel);
+    {
+      profiler::scope prof(profiler::phase::occupancy);
+      landscape_.update_occupancy(Layers::foragers_count, Layers::foragers, Layers::klepts_count, Layers::klepts, Layers::handlers_count, Layers::handlers, Layers::nonhandlers, agents_.pop, param_.landscape.foragers_kernel);
+    }
 
   }
 
+
+  void Simulation::grow_items(const rnd::streams& rs)
+  {
+    using Layers = Landscape::Layers;
+    profiler::scope prof(profiler::phase::growth);
+
+    const auto max_items = static_cast<Landscape::item_t>(floor(param_.landscape.max_item_cap));
+    if (param_.landscape.regrowth == Regrowth::wheel) {
+      regrowth_.grow(landscape_, max_items, rs);
+      return;
+    }
+    const int D = landscape_.dim();
+    Landscape::item_t* __restrict items = landscape_.items_layer().data();					//items now refers to the layer of food items (in landscape)
+    float* __restrict capacity = landscape_[Layers::capacity].data();			//capacity refers to the maximum capacity layer (in landscape)
+    ann_assume_aligned(items, 32);
+    const float item_growth = param_.landscape.item_growth;
+    const int tile = 1 << landscape_.tile_shift();
+#   pragma omp parallel
+    {
+      profiler::scope prof_thread(profiler::phase::growth_thread);
+#     pragma omp for schedule(static)
+      for (int y = 0; y < D; ++y) {
+        auto reng = rs(rnd::purpose::item_growth, y);   // one stream per row
+        for (int x = 0; x < D; x += tile) {             // row segments in memory
+          const int i0 = landscape_.index(x, y);
+          for (int i = i0; i < i0 + tile; ++i) {
+            if (std::bernoulli_distribution(item_growth * capacity[i])(reng) ) {  // altered: probability that items drop, && capacity[i] > 0.2
+              items[i] = std::min(max_items, static_cast<Landscape::item_t>(items[i] + 1));
+            }
+          }
+        }
+      }
+    }
+  }
+
   void Simulation::update_landscaperecord()
   {
     using Layers = Landscape::Layers;
 
     // grass growth
     const int DD = landscape_.dim() * landscape_.dim();
-    float* __restrict items = landscape_[Layers::items].data();					//items now refers to the layer of food items (in landscape)
-    float* __restrict foragers_count = landscape_[Layers::foragers_count].data();			//capacity refers to the maximum capacity layer (in landscape)
-    float* __restrict klepts_count = landscape_[Layers::klepts_count].data();			//capacity refers to the maximum capacity layer (in landscape)
+    const Landscape::item_t* __restrict items = landscape_.items_layer().data();					//items now refers to the layer of food items (in landscape)
+    const Landscape::count_t* __restrict foragers_count = landscape_.count_layer(Layers::foragers_count).data();			//capacity refers to the maximum capacity layer (in landscape)
+    const Landscape::count_t* __restrict klepts_count = landscape_.count_layer(Layers::klepts_count).data();			//capacity refers to the maximum capacity layer (in landscape)
     float* __restrict items_rec = landscape_[Layers::items_rec].data();			//capacity refers to the maximum capacity layer (in landscape)
     float* __restrict foragers_rec = landscape_[Layers::foragers_rec].data();			//capacity refers to the maximum capacity layer (in landscape)
     float* __restrict klepts_rec = landscape_[Layers::klepts_rec].data();			//capacity refers to the maximum capacity layer (in landscape)
-    //#   pragma omp parallel for schedule(static)
-
+#   pragma omp parallel for simd schedule(static)
     for (int i = 0; i < DD; ++i) {
       items_rec[i] += items[i];
       foragers_rec[i] += foragers_count[i];
@@ -347,78 +462,72 @@ namespace cine2 {
     detail::assess_inds(agents_);
   }
 
-  void Simulation::create_new_generations()
+  void Simulation::create_new_generations(int g)
   {
-    detail::create_new_generation(landscape_, agents_, param_.agents, fixed());
+    profiler::scope prof(profiler::phase::new_generation);
+    detail::create_new_generation(landscape_, agents_, param_.agents, fixed(), streams(g, param_.T));
   }
 
 
-  void Simulation::resolve_grazing_and_attacks()
+  void Simulation::resolve_grazing_and_attacks(const rnd::streams& rs)
   {
     using Layers = Landscape::Layers;
-    const float detection_rate = param_.landscape.detection_rate;
+    profiler::scope prof(profiler::phase::attacks);
     //LayerView foragers_count = landscape_[Layers::foragers_count];
     //LayerView klepts_count = landscape_[Layers::klepts_count];
     //LayerView capacity = landscape_[Layers::capacity];
-    LayerView items = landscape_[Layers::items];
+    ItemLayerView items = landscape_.items_layer();
     LayerView foragers_intake = landscape_[Layers::foragers_intake];
     LayerView klepts_intake = landscape_[Layers::klepts_intake];
-    LayerView handlers = landscape_[Layers::handlers_count];
-    LayerView old_grass = landscape_[Layers::temp];
-    old_grass.copy(handlers);
+    CountLayerView handlers = landscape_.count_layer(Layers::handlers_count);
 
 
     attacking_inds_.clear();
-    attacked_potentially_.clear();
-    attacked_inds.clear();
-
-    auto last_agents = agents_.pop.data() + agents_.pop.size();
-
+    conflicts_.clear();
 
-    for (int i = 0; i < agents_.pop.size(); ++i) {
-      if (!agents_.pop[i].handling && !agents_.pop[i].foraging) {
+    const int N = agents_.pop.size();
+    const Coordinate* __restrict agent_pos = agents_.pop.pos();
+    const uint8_t* __restrict agent_flags = agents_.pop.flags();
+    for (int i = 0; i < N; ++i) {
+      if (!(agent_flags[i] & (Individuals::handling | Individuals::foraging))) {
 
-        const Coordinate pos = agents_.pop[i].pos;
-        if (handlers(pos) >= 1.0f) {
+        const Coordinate pos = agent_pos[i];
+        if (handlers(pos) >= 1) {
           attacking_inds_.push_back(i);
 
         }
       }
     }
 
+    // potential victims: handlers in the same cell, looked up through the
+    // cell index built by the last update_occupancy
+    const AgentIndex& cell_agents = landscape_.agent_index();
     for (auto i : attacking_inds_) {						//cycle through the agents in that same vector
-
-      for (auto attacked_pot = agents_.pop.data(); attacked_pot != last_agents; ++attacked_pot) {
-        const Coordinate pos = attacked_pot->pos;
-        if (agents_.pop[i].pos == pos && &agents_.pop[i] != attacked_pot) {  // self excluded
-          if (attacked_pot->handling) {
-            attacked_potentially_.push_back(attacked_pot);
-
-          }
+      attacked_potentially_.clear();
+      const Coordinate pos = agent_pos[i];
+      for (auto it = cell_agents.begin(pos); it != cell_agents.end(pos); ++it) {
+        if (*it != i && (agent_flags[*it] & Individuals::handling)) {  // self excluded
+          attacked_potentially_.push_back(*it);
         }
       }
       if (!attacked_potentially_.empty()) {								//if then that vector is NOT empty
         std::uniform_int_distribution<int> rind(0, static_cast<int>(attacked_potentially_.size() - 1));		//sample one (random)
-        int focal_ind = rind(rnd::reng);																	//now called "focal_ind"
-        attacked_inds.push_back(attacked_potentially_[focal_ind]);			//added to the vector of ACTUALLY ATTACKED.
-
-        attacked_potentially_.clear();										//clearing the POTENTIALLY ATTACKED vector
+        auto reng = rs(rnd::purpose::attack, i);
+        int focal_ind = rind(reng);																	//now called "focal_ind"
+        conflicts_.emplace_back(i, attacked_potentially_[focal_ind]);			//added to the vector of ACTUALLY ATTACKED.
       }
 
     }
 
 
-    assert(attacked_inds.size() == attacking_inds_.size() && "vector lengths uneven");
+    assert(conflicts_.size() == attacking_inds_.size() && "vector lengths uneven");
 
     // Shuffling
-    std::vector<std::pair<int, Individual*>> conflicts_v(attacking_inds_.size());
-    for (int i = 0; i < attacking_inds_.size(); ++i) {
-      conflicts_v[i] = { attacking_inds_[i], attacked_inds[i] };
-    }
-    std::shuffle(conflicts_v.begin(), conflicts_v.end(), rnd::reng);
+    auto conflict_reng = rs(rnd::purpose::conflict, 0);
+    std::shuffle(conflicts_.begin(), conflicts_.end(), conflict_reng);
 
 
-    for (int i = 0; i < conflicts_v.size(); i++) {				//cycle through the agents who attack
+    for (const auto& conflict : conflicts_) {				//cycle through the agents who attack
       float prob_to_fight = 1.0f;									//they always fight
 
       //if (attacked_inds[i]->handle())
@@ -426,21 +535,22 @@ namespace cine2 {
       //else
       //  prob_to_fight = 0.2f;
 
-
+      const auto attacker = agents_.pop[conflict.first];
+      const auto attacked = agents_.pop[conflict.second];
       std::bernoulli_distribution fight(prob_to_fight);								//sampling whether fight occurs
       std::bernoulli_distribution initiator_wins(1.0)/*initiator always wins*/;		//sampling whether the initiator wins or not
-      if (conflicts_v[i].second->handling) {			///isn't this always true?
-        if (fight(rnd::reng)) {
-          if (initiator_wins(rnd::reng)) {
+      if (attacked.handling()) {			///isn't this always true?
+        if (fight(conflict_reng)) {
+          if (initiator_wins(conflict_reng)) {
 
-            agents_.pop[conflicts_v[i].first].handling = conflicts_v[i].second->handling;
-            agents_.pop[conflicts_v[i].first].handle_time = conflicts_v[i].second->handle_time;
+            attacker.handling(attacked.handling());
+            attacker.handle_time() = attacked.handle_time();
             //attacking_inds_[i]->food += 1.0f;
-            conflicts_v[i].second->flee(landscape_, param_.agents.flee_radius);
+            attacked.flee(landscape_, param_.agents.flee_radius, conflict_reng);
 
           }
           else
-            agents_.pop[conflicts_v[i].first].attacker_flee(landscape_, param_.agents.flee_radius);
+            attacker.attacker_flee(landscape_, param_.agents.flee_radius, conflict_reng);
           //Energetic costs
 
           //attacking_inds_[i]->food -= 0.0f;
@@ -451,52 +561,66 @@ namespace cine2 {
       }
     }
 
-    agents_.conflicts += static_cast<int>(conflicts_v.size());
-
-    conflicts_v.clear();
-
-    std::shuffle(shuffle_vec.begin(), shuffle_vec.end(), rnd::reng);
+    agents_.conflicts += static_cast<int>(conflicts_.size());
 
+    // fleeing agents changed cells
+    if (!conflicts_.empty()) {
+      landscape_.update_agent_index(agents_.pop);
+    }
 
-
-    for (int i : shuffle_vec) {
-      auto& agent = agents_.pop[i];
-      //for (auto agents = agents_.pop.data(); agents != last_agents; ++agents) {
-      if (agent.handle() == false) {
-        const Coordinate pos = agent.pos;
-
-        if (agent.foraging && !agent.just_lost) {
-          if (items(pos) >= 1.0f) {
-            if (std::bernoulli_distribution(1.0 - pow((1.0f - detection_rate), items(pos)))(rnd::reng)) { // Ind searching for items
-              agent.pick_item(param_.agents.handling_time);
-              items(pos) -= 1.0f;
-            }
-          }
+    // handling countdown of all agents at once. The ones done handling
+    // carry the handled flag into the cell pass.
+    prof.next(profiler::phase::foraging);
+    agents_.pop.do_handle();
+
+    // Agents only compete for the items in their own cell: the cells are
+    // independent and run in parallel, in random order within each cell.
+    // One random stream per cell keeps the outcome thread-count independent.
+    // The streams are keyed by the row-major cell index for any layout.
+    AgentIndex& foraging_order = landscape_.agent_index();
+    const std::vector<int>& occupied = foraging_order.occupied();
+    const int C = static_cast<int>(occupied.size());
+    const int D = landscape_.dim();
+#   pragma omp parallel
+    {
+      profiler::scope prof_thread(profiler::phase::foraging_thread);
+#     pragma omp for schedule(static)
+      for (int k = 0; k < C; ++k) {
+        const int cell = occupied[k];
+        const Coordinate cell_pos = agent_pos[*foraging_order.begin(cell)];
+        auto forage_reng = rs(rnd::purpose::forage, cell_pos.y * D + cell_pos.x);
+        if (foraging_order.count(cell) > 1) {
+          std::shuffle(foraging_order.begin(cell), foraging_order.end(cell), forage_reng);
         }
-      }
-
-
-
-      else {
-        if (agent.do_handle()) {
-          if (agent.foraging) {
-            foragers_intake(agent.pos) += 1.0f;
+        for (auto it = foraging_order.begin(cell); it != foraging_order.end(cell); ++it) {
+          const auto agent = agents_.pop[*it];
+          if (agent.handled()) {
+            if (agent.foraging()) {
+              foragers_intake(agent.pos()) += 1.0f;
 
+            }
+            else {
+              klepts_intake(agent.pos()) += 1.0f;
+            }
+            agent.handled(false);
           }
-          else {
-            klepts_intake(agent.pos) += 1.0f;
+          else if (agent.handle() == false) {
+            const Coordinate pos = agent.pos();
+
+            if (agent.foraging() && !agent.just_lost()) {
+              if (items(pos) >= 1) {
+                if (std::bernoulli_distribution(detection_prob_[items(pos)])(forage_reng)) { // Ind searching for items
+                  agent.pick_item(param_.agents.handling_time);
+                  items(pos) -= 1;
+                }
+              }
+            }
           }
-        }
 
-      }
-
-      if (agent.just_lost) {
-        agent.just_lost = false;
+          agent.just_lost(false);
+        }
       }
     }
-
-
-
   }
 
 
@@ -504,7 +628,7 @@ namespace cine2 {
   {
     Image image(std::string("../settings/") + imla.image);
     if (landscape_.dim() == 0) {
-      landscape_ = Landscape(image.width());
+      landscape_ = Landscape(image.width(), param_.landscape.layout);
     }
     if (!(image.width() == landscape_.dim() && image.height() == landscape_.dim())) {
       throw std::runtime_error("image dimension mismatch");
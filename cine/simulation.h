@@ -4,6 +4,7 @@
 #include <memory>
 #include <vector>
 #include "landscape.h"
+#include "regrowth.h"
 #include "image.h"
 #include "parameter.h"
 #include "observer.h"
@@ -17,15 +18,16 @@ namespace cine2 {
 
   struct Population
   {
-    std::vector<Individual> pop;        // curent pooulation
-    std::vector<Individual> tmp_pop;    // new generation during reproduction, ancestors otherwise
+    Individuals pop;                    // curent pooulation
+    Individuals tmp_pop;                // new generation during reproduction, ancestors otherwise
     std::unique_ptr<any_ann> ann;       // Ann's of current population
     std::unique_ptr<any_ann> tmp_ann;   // new Anns during reproduction, ancestors Anns otherwise
     std::vector<float> foraged;         // fitness after last timestep
     std::vector<float> handled;         // fitness after last timestep
 	int conflicts;
     std::vector<float> fitness;         // fitness after last timestep
-    rndutils::mutable_discrete_distribution<int, rndutils::all_zero_policy_uni> rdist;  // reproduction distr.
+    rndutils::alias_distribution<int, rndutils::all_zero_policy_uni> rdist;  // reproduction distr.
+    std::vector<int> ancestors;         // systematic sampling: ancestor of offspring i
   };
 
 
@@ -41,6 +43,7 @@ namespace cine2 {
       GENERATION,           // send after final timestep in one generation
       FINISHED,             // send if simulation is done and busted
       WATCHDOG,             // send to confirm app is running
+      CHECKPOINT,           // send before a resume checkpoint is saved
     };
 
   public: 
@@ -57,28 +60,48 @@ namespace cine2 {
     bool fixed() const { return (g_ >= 0) && (g_ > param_.Gfix); }
     int dim() const { return landscape_.dim(); }
 
+    // first generation of run(), > 0 if resumed from a checkpoint
+    int first_generation() const { return g0_; }
+
+    // {attacker, attacked} of the last timestep
+    const std::vector<std::pair<int, int>>& conflicts() const { return conflicts_; }
+
     // returns completion
     bool run(Observer* observer = nullptr); 
 
+    // writes the state before timestep t of generation g, see checkpoint.h
+    void save_checkpoint(const std::string& file, int g, int t) const;
+
   private:
-    void simulate_timestep(int t);
+    friend class KernelBench;     // bench/kernels.cpp
+
+    void simulate_timestep(int g, int t);
+    void grow_items(const rnd::streams& rs);
     void update_landscaperecord();
     void assess_fitness();
     void assess_inds();
-    void create_new_generations();
-    void resolve_grazing_and_attacks();
+    void create_new_generations(int g);
+    void resolve_grazing_and_attacks(const rnd::streams& rs);
     void init_layer(image_layer imla);
     void init_anns_from_archive(Population& Pop, archive::iarch& ia);
+    void restore_checkpoint(const std::string& file);
+    std::string replay_snapshot(int g) const;     // <outdir>/replay/<g>.bin
+
+    // random streams at generation g, timestep t. Burn-in generations
+    // are negative, -Gburnin - 1 is the initialization.
+    rnd::streams streams(int g, int t) const { return { param_.seed, g, t }; }
 
     int g_, t_;
+    int g0_, t0_;     // resume point
     const Param param_;
     Population agents_;
     //Population pred_;
     std::vector<int> attacking_inds_;
-    std::vector<Individual*> attacked_potentially_;
-    std::vector<Individual*> attacked_inds;
-    std::vector<int> shuffle_vec;
+    std::vector<int> attacked_potentially_;
+    std::vector<std::pair<int, int>> conflicts_;    // {attacker, attacked}
+    std::vector<double> detection_prob_;            // [items] probability to find an item
     Landscape landscape_;
+    ItemRegrowth regrowth_;                         // landscape.regrowth = wheel
     Analysis analysis_;
   };
 
@@ -6,9 +6,11 @@
 
 
 // For Luis: force the execution on the GPU, and therefore allow openGL compatibility.
+#if defined(_WIN32)
 extern "C" {
 	__declspec(dllexport) DWORD NvOptimusEnablement = 0x00000001;
 }
+#endif
 
 
 namespace bmf = glsl::bmfont;
@@ -98,7 +100,7 @@ namespace cinema {
 
     // copy capacity layer
     auto dst = (float*)ptr_[VBO_LAYER] + 3 * dim_ * dim_;
-    std::memcpy(dst, sim->landscape()[cine2::Landscape::Layers::items].data(), dim_ * dim_ * sizeof(float));
+    sim->landscape().layer_to_float(cine2::Landscape::Layers::items, dst);
   }
 
 
@@ -121,7 +123,10 @@ namespace cinema {
       std::memcpy(ptr_[VBO::VBO_AGENTS_ANN], sim.agents().ann->data(), agents_ann_.N * agents_ann_.type_size);
       //std::memcpy(ptr_[VBO::VBO_PRED_ANN], sim.pred().ann->data(), pred_ann_.N * pred_ann_.type_size);
     case msg_type::POST_TIMESTEP: {
-      std::memcpy(ptr_[VBO::VBO_LAYER], sim.landscape().data(), 4 * dim_* dim_ * sizeof(float));  // CN: changed from 3 to 4, to update items layer!!
+      for (int l = 0; l < 3; ++l) {   // foragers, klepts, handlers
+        sim.landscape().layer_to_float(Layers(Layers::foragers + l), (float*)ptr_[VBO::VBO_LAYER] + l * dim_ * dim_);
+      }
+      sim.landscape().layer_to_float(Layers::items, (float*)ptr_[VBO::VBO_LAYER] + 3 * dim_ * dim_);   // quantized
       break;
     }
     }
@@ -0,0 +1,193 @@
+/* lz4.c -- minimal codec for the LZ4 block format, see lz4.h
+
+  Block format: a sequence is
+    token                 literal length (high nibble), match length - 4 (low nibble)
+    [literal length]      if high nibble == 15: bytes added until one is < 255
+    literals
+    offset                2 bytes little endian, 1..65535
+    [match length]        if low nibble == 15: bytes added until one is < 255
+  The last sequence holds literals only. The last match starts at least
+  12 bytes before the end of the block, the last 5 bytes are literals.
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include "lz4.h"
+
+
+#define MINMATCH      4
+#define LASTLITERALS  5
+#define MFLIMIT       12
+#define HASH_LOG      14
+#define MAX_DISTANCE  65535
+#define SKIP_TRIGGER  6
+
+
+static uint32_t read32(const uint8_t* p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+
+static uint32_t hash32(uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+
+static uint8_t* write_length(uint8_t* op, size_t len)
+{
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+
+/* worst case bytes of a sequence with litlen literals and match length mlen - 4 */
+static size_t sequence_bound(size_t litlen, size_t mlen)
+{
+  return 1 + (litlen / 255 + 1) + litlen + 2 + (mlen / 255 + 1);
+}
+
+
+int LZ4_compressBound(int isize)
+{
+  return (isize < 0 || isize > LZ4_MAX_INPUT_SIZE) ? 0 : isize + isize / 255 + 16;
+}
+
+
+int LZ4_compress_default(const char* source, char* dest, int srcSize, int dstCapacity)
+{
+  const uint8_t* const src = (const uint8_t*)source;
+  const uint8_t* const iend = src + srcSize;
+  const uint8_t* const mflimit = iend - MFLIMIT;
+  const uint8_t* const matchlimit = iend - LASTLITERALS;
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  uint8_t* op = (uint8_t*)dest;
+  uint8_t* const oend = op + dstCapacity;
+  uint32_t table[1 << HASH_LOG];
+  size_t litlen;
+
+  if (srcSize < 0 || srcSize > LZ4_MAX_INPUT_SIZE || dstCapacity < 0) return 0;
+  if (srcSize > MFLIMIT) {
+    memset(table, 0, sizeof(table));
+    ++ip;
+    while (ip < mflimit) {
+      const uint32_t seq = read32(ip);
+      const uint32_t h = hash32(seq);
+      const uint8_t* ref = src + table[h];
+      table[h] = (uint32_t)(ip - src);
+      if (ref < ip && (size_t)(ip - ref) <= MAX_DISTANCE && read32(ref) == seq) {
+        const uint8_t* p = ip + MINMATCH;
+        const uint8_t* r = ref + MINMATCH;
+        uint8_t* token;
+        size_t mlen;
+        uint16_t offset;
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+          --ip;
+          --ref;
+        }
+        while (p < matchlimit && *p == *r) {
+          ++p;
+          ++r;
+        }
+        litlen = (size_t)(ip - anchor);
+        mlen = (size_t)(p - ip) - MINMATCH;
+        if (sequence_bound(litlen, mlen) > (size_t)(oend - op)) return 0;
+        token = op++;
+        *token = (uint8_t)((litlen >= 15 ? 15 : litlen) << 4);
+        if (litlen >= 15) op = write_length(op, litlen - 15);
+        memcpy(op, anchor, litlen);
+        op += litlen;
+        offset = (uint16_t)(ip - ref);
+        *op++ = (uint8_t)(offset & 255);
+        *op++ = (uint8_t)(offset >> 8);
+        if (mlen >= 15) {
+          *token |= 15;
+          op = write_length(op, mlen - 15);
+        }
+        else {
+          *token |= (uint8_t)mlen;
+        }
+        ip = anchor = p;
+        if (ip < mflimit) {
+          table[hash32(read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+        }
+      }
+      else {
+        /* accelerate through incompressible data */
+        ip += 1 + ((size_t)(ip - anchor) >> SKIP_TRIGGER);
+      }
+    }
+  }
+  /* last literals */
+  litlen = (size_t)(iend - anchor);
+  if (1 + (litlen / 255 + 1) + litlen > (size_t)(oend - op)) return 0;
+  *op++ = (uint8_t)((litlen >= 15 ? 15 : litlen) << 4);
+  if (litlen >= 15) op = write_length(op, litlen - 15);
+  memcpy(op, anchor, litlen);
+  op += litlen;
+  return (int)(op - (uint8_t*)dest);
+}
+
+
+int LZ4_decompress_safe(const char* source, char* dest, int compressedSize, int dstCapacity)
+{
+  const uint8_t* ip = (const uint8_t*)source;
+  const uint8_t* const iend = ip + compressedSize;
+  uint8_t* op = (uint8_t*)dest;
+  uint8_t* const oend = op + dstCapacity;
+
+  if (compressedSize <= 0 || dstCapacity < 0) return -1;
+  for (;;) {
+    const unsigned token = *ip++;
+    size_t len = token >> 4;
+    size_t offset;
+    const uint8_t* match;
+    if (len == 15) {
+      unsigned s;
+      do {
+        if (ip >= iend) return -1;
+        s = *ip++;
+        len += s;
+      } while (s == 255);
+    }
+    if ((size_t)(iend - ip) < len || (size_t)(oend - op) < len) return -1;
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+    if (ip == iend) break;    /* last sequence */
+    if (iend - ip < 2) return -1;
+    offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - (uint8_t*)dest)) return -1;
+    len = token & 15;
+    if (len == 15) {
+      unsigned s;
+      do {
+        if (ip >= iend) return -1;
+        s = *ip++;
+        len += s;
+      } while (s == 255);
+    }
+    len += MINMATCH;
+    if ((size_t)(oend - op) < len) return -1;
+    match = op - offset;
+    if (offset >= len) {
+      memcpy(op, match, len);
+      op += len;
+    }
+    else {
+      /* overlapping: repeats the last offset bytes */
+      while (len--) *op++ = *match++;
+    }
+    if (ip >= iend) return -1;
+  }
+  return (int)(op - (uint8_t*)dest);
+}
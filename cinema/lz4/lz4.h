@@ -0,0 +1,38 @@
+/* lz4.h -- minimal codec for the LZ4 block format
+
+  Compatible subset of the upstream lz4.h API (https://github.com/lz4/lz4):
+  LZ4_compressBound, LZ4_compress_default and LZ4_decompress_safe produce
+  and consume standard LZ4 blocks, thus lz4.c can be replaced by the
+  upstream sources without touching the callers.
+
+  The compressor is a greedy single-pass matcher with a 2^14 entry hash
+  table and skip acceleration on incompressible input. It favours speed
+  over ratio, like LZ4_compress_default.
+*/
+
+#ifndef LZ4_H_INCLUDED
+#define LZ4_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LZ4_MAX_INPUT_SIZE 0x7E000000   /* 2 113 929 216 bytes */
+
+/* maximum compressed size of isize bytes, 0 if isize is too large */
+int LZ4_compressBound(int isize);
+
+/* compresses srcSize bytes from src into dst[dstCapacity].
+   returns the compressed size, 0 if dst is too small */
+int LZ4_compress_default(const char* src, char* dst, int srcSize, int dstCapacity);
+
+/* decompresses a block of compressedSize bytes into dst[dstCapacity].
+   returns the decompressed size, < 0 on malformed input; never writes
+   outside dst and never reads outside src */
+int LZ4_decompress_safe(const char* src, char* dst, int compressedSize, int dstCapacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
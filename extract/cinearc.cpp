@@ -0,0 +1,214 @@
+#define CINEARC_BUILD
+#include "cinearc.h"
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cine/archive.hpp>
+
+
+struct cinearc
+{
+  explicit cinearc(const char* file) : ia(file), header(ia.header()) {}
+
+  archive::mapped_iarch ia;
+  std::string header;
+};
+
+
+namespace {
+
+  thread_local std::string last_error;
+
+
+  // C++ exceptions don't cross the C interface
+  struct error : std::runtime_error
+  {
+    error(int code, const std::string& what) : std::runtime_error(what), code(code) {}
+    int code;
+  };
+
+
+  template <typename Fun>
+  int guarded(Fun&& fun)
+  {
+    try {
+      last_error.clear();
+      fun();
+      return CINEARC_OK;
+    }
+    catch (const error& err) {
+      last_error = err.what();
+      return err.code;
+    }
+    catch (const std::exception& err) {
+      last_error = err.what();
+    }
+    catch (...) {
+      last_error = "unknown exception";
+    }
+    return CINEARC_ERROR;
+  }
+
+
+  const archive::mapped_iarch& checked(const cinearc* arc)
+  {
+    if (arc == nullptr) throw error(CINEARC_EINVAL, "null handle");
+    return arc->ia;
+  }
+
+
+  const archive::dict& checked_entry(const cinearc* arc, int64_t g)
+  {
+    const auto& ia = checked(arc);
+    if (g < 0 || static_cast<uint64_t>(g) >= ia.size()) throw error(CINEARC_ERANGE, "generation out of range");
+    return ia.entry(static_cast<size_t>(g));
+  }
+
+
+  size_t blob_bytes(const archive::dict& e)
+  {
+    return size_t(e.un) * e.usize;
+  }
+
+
+  // selected generations and their common blob size
+  std::vector<size_t> checked_range(const cinearc* arc, int64_t g0, int64_t g1, int64_t stride, size_t& bytes)
+  {
+    if (stride <= 0) throw error(CINEARC_EINVAL, "stride shall be > 0");
+    std::vector<size_t> idx;
+    bytes = 0;
+    for (int64_t g = g0; g < g1; g += stride) {
+      const size_t b = blob_bytes(checked_entry(arc, g));
+      if (!idx.empty() && b != bytes) throw error(CINEARC_ESIZE, "blob size varies between generations");
+      bytes = b;
+      idx.push_back(static_cast<size_t>(g));
+    }
+    return idx;
+  }
+
+
+  // uncompresses idx into dst, blob after blob
+  void read_range(const cinearc* arc, const std::vector<size_t>& idx, size_t bytes, unsigned char* dst, int threads)
+  {
+    std::vector<void*> ptr(idx.size());
+    for (size_t i = 0; i < idx.size(); ++i) ptr[i] = dst + i * bytes;
+    arc->ia.extract_list(idx, ptr.data(), threads);
+  }
+
+}
+
+
+extern "C" {
+
+  int cinearc_version(void)
+  {
+    return CINEARC_VERSION;
+  }
+
+
+  const char* cinearc_last_error(void)
+  {
+    return last_error.c_str();
+  }
+
+
+  int cinearc_open(const char* file, cinearc** arc)
+  {
+    if (arc) *arc = nullptr;
+    return guarded([&]() {
+      if (file == nullptr || arc == nullptr) throw error(CINEARC_EINVAL, "null argument");
+      *arc = new cinearc(file);
+    });
+  }
+
+
+  void cinearc_close(cinearc* arc)
+  {
+    delete arc;
+  }
+
+
+  const char* cinearc_header(const cinearc* arc)
+  {
+    return arc ? arc->header.c_str() : "";
+  }
+
+
+  int64_t cinearc_generations(const cinearc* arc)
+  {
+    int64_t n = CINEARC_EINVAL;
+    guarded([&]() { n = static_cast<int64_t>(checked(arc).size()); });
+    return n;
+  }
+
+
+  int cinearc_blob_info(const cinearc* arc, int64_t g, cinearc_blob* info)
+  {
+    return guarded([&]() {
+      if (info == nullptr) throw error(CINEARC_EINVAL, "null argument");
+      const auto& e = checked_entry(arc, g);
+      *info = { e.un, e.usize, e.csize, static_cast<uint8_t>(e.codec_id), e.filters, e.typesize, 0 };
+    });
+  }
+
+
+  int cinearc_read(const cinearc* arc, int64_t g, void* dst, size_t bytes)
+  {
+    return guarded([&]() {
+      const auto& e = checked_entry(arc, g);
+      if (dst == nullptr && blob_bytes(e)) throw error(CINEARC_EINVAL, "null argument");
+      if (bytes < blob_bytes(e)) throw error(CINEARC_ESIZE, "buffer too small");
+      arc->ia.decode(static_cast<size_t>(g), dst);
+    });
+  }
+
+
+  int cinearc_read_range(const cinearc* arc, int64_t g0, int64_t g1, int64_t stride, void* dst, size_t bytes, int threads)
+  {
+    return guarded([&]() {
+      size_t blob = 0;
+      const auto idx = checked_range(arc, g0, g1, stride, blob);
+      if (dst == nullptr && idx.size() * blob) throw error(CINEARC_EINVAL, "null argument");
+      if (bytes < idx.size() * blob) throw error(CINEARC_ESIZE, "buffer too small");
+      read_range(arc, idx, blob, (unsigned char*)dst, threads);
+    });
+  }
+
+
+  int cinearc_read_range_f64(const cinearc* arc, int64_t g0, int64_t g1, int64_t stride, double* dst, size_t count, int threads)
+  {
+    return guarded([&]() {
+      size_t blob = 0;
+      const auto idx = checked_range(arc, g0, g1, stride, blob);
+      if (blob % sizeof(float)) throw error(CINEARC_ESIZE, "blob size isn't a multiple of float");
+      const size_t n = idx.size() * (blob / sizeof(float));
+      if (dst == nullptr && n) throw error(CINEARC_EINVAL, "null argument");
+      if (count < n) throw error(CINEARC_ESIZE, "buffer too small");
+      std::vector<float> f(n);
+      read_range(arc, idx, blob, (unsigned char*)f.data(), threads);
+      for (size_t i = 0; i < n; ++i) {
+        dst[i] = static_cast<double>(f[i]);
+      }
+    });
+  }
+
+
+  int cinearc_read_column_f64(const cinearc* arc, int64_t g, uint32_t col, double* dst, size_t count)
+  {
+    return guarded([&]() {
+      const auto& e = checked_entry(arc, g);
+      if (dst == nullptr && e.un) throw error(CINEARC_EINVAL, "null argument");
+      if ((size_t(col) + 1) * sizeof(float) > e.usize) throw error(CINEARC_ERANGE, "column out of range");
+      if (count < e.un) throw error(CINEARC_ESIZE, "buffer too small");
+      std::vector<unsigned char> buf(blob_bytes(e));
+      arc->ia.decode(static_cast<size_t>(g), buf.data());
+      for (size_t i = 0; i < e.un; ++i) {
+        float x;
+        std::memcpy(&x, buf.data() + i * e.usize + col * sizeof(float), sizeof(float));
+        dst[i] = static_cast<double>(x);
+      }
+    });
+  }
+
+}
@@ -0,0 +1,93 @@
+/* cinearc.h -- C interface to the simulation archives (*.arc)
+
+  Reads the archives in-process, e.g. from R (.Call, see cinearc_R.c) or
+  Python (ctypes, see cinearc.py), without extract and temporary files.
+
+  All functions return CINEARC_OK (0) or a negative error code; the
+  message of the last error of the calling thread is returned by
+  cinearc_last_error. Blobs are written into caller-owned buffers;
+  a buffer that is too small is an error, nothing is written.
+
+  A handle may be shared between threads.
+*/
+
+#ifndef CINEARC_H_INCLUDED
+#define CINEARC_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+# if defined(CINEARC_BUILD)
+#   define CINEARC_API __declspec(dllexport)
+# else
+#   define CINEARC_API __declspec(dllimport)
+# endif
+#else
+# define CINEARC_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CINEARC_VERSION 1
+
+enum {
+  CINEARC_OK = 0,
+  CINEARC_ERROR = -1,         /* I/O, corrupt archive */
+  CINEARC_EINVAL = -2,        /* invalid argument, e.g. null handle */
+  CINEARC_ERANGE = -3,        /* generation out of range */
+  CINEARC_ESIZE = -4,         /* buffer too small, blob size mismatch */
+};
+
+typedef struct cinearc cinearc;
+
+typedef struct cinearc_blob
+{
+  uint32_t n;                 /* number of records (individuals) */
+  uint32_t size;              /* record size [byte] */
+  uint32_t csize;             /* compressed size [byte] */
+  uint8_t codec;              /* 0: deflate, 1: lz4, 2: store */
+  uint8_t filters;            /* bit set: 1 shuffle, 2 bitshuffle, 4 xor_delta */
+  uint8_t typesize;           /* element size of the shuffle filters */
+  uint8_t reserved;
+} cinearc_blob;
+
+/* CINEARC_VERSION of the library */
+CINEARC_API int cinearc_version(void);
+
+/* message of the last error of the calling thread, "" if none */
+CINEARC_API const char* cinearc_last_error(void);
+
+/* opens an archive, one that is still written as of now; *arc is null on failure */
+CINEARC_API int cinearc_open(const char* file, cinearc** arc);
+CINEARC_API void cinearc_close(cinearc* arc);
+
+/* zero terminated header, e.g. the ann type of agents_ann.arc */
+CINEARC_API const char* cinearc_header(const cinearc* arc);
+
+/* number of generations (blobs), < 0 on error */
+CINEARC_API int64_t cinearc_generations(const cinearc* arc);
+
+CINEARC_API int cinearc_blob_info(const cinearc* arc, int64_t g, cinearc_blob* info);
+
+/* uncompressed blob g, n * size bytes */
+CINEARC_API int cinearc_read(const cinearc* arc, int64_t g, void* dst, size_t bytes);
+
+/* blobs g0, g0 + stride, ... < g1, back to back; all blobs shall have the
+   same size. Uncompressed on threads threads, 0: all cores */
+CINEARC_API int cinearc_read_range(const cinearc* arc, int64_t g0, int64_t g1, int64_t stride, void* dst, size_t bytes, int threads);
+
+/* as cinearc_read_range, float32 elements widened to double; count: capacity of dst */
+CINEARC_API int cinearc_read_range_f64(const cinearc* arc, int64_t g0, int64_t g1, int64_t stride, double* dst, size_t count, int threads);
+
+/* float32 element col of every record of blob g as double, n values;
+   e.g. weight col of all anns */
+CINEARC_API int cinearc_read_column_f64(const cinearc* arc, int64_t g, uint32_t col, double* dst, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
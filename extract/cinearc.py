@@ -0,0 +1,126 @@
+"""cinearc.py -- Python binding of cinearc (ctypes)
+
+    import cinearc
+    with cinearc.Archive("agents_fit.arc") as arc:
+        fit = arc.read_range(0, len(arc))           # array('d'), generation after generation
+        anc = cinearc.Archive("agents_anc.arc").read(10, "i")
+
+The library is searched in $CINEARC_LIB, next to this file and in the
+system paths. numpy.frombuffer(fit) gives a zero-copy numpy view.
+"""
+
+import array
+import ctypes
+import ctypes.util
+import os
+import sys
+
+
+class Blob(ctypes.Structure):
+    _fields_ = [("n", ctypes.c_uint32),
+                ("size", ctypes.c_uint32),
+                ("csize", ctypes.c_uint32),
+                ("codec", ctypes.c_uint8),
+                ("filters", ctypes.c_uint8),
+                ("typesize", ctypes.c_uint8),
+                ("reserved", ctypes.c_uint8)]
+
+
+def _load():
+    names = {"win32": "cinearc.dll", "darwin": "libcinearc.dylib"}
+    name = names.get(sys.platform, "libcinearc.so")
+    candidates = [os.environ.get("CINEARC_LIB"),
+                  os.path.join(os.path.dirname(os.path.abspath(__file__)), name),
+                  ctypes.util.find_library("cinearc")]
+    for path in filter(None, candidates):
+        try:
+            lib = ctypes.CDLL(path)
+            break
+        except OSError:
+            continue
+    else:
+        raise OSError("cinearc library not found, set CINEARC_LIB")
+    arc_p = ctypes.c_void_p
+    i64 = ctypes.c_int64
+    lib.cinearc_last_error.restype = ctypes.c_char_p
+    lib.cinearc_open.argtypes = [ctypes.c_char_p, ctypes.POINTER(arc_p)]
+    lib.cinearc_close.argtypes = [arc_p]
+    lib.cinearc_close.restype = None
+    lib.cinearc_header.argtypes = [arc_p]
+    lib.cinearc_header.restype = ctypes.c_char_p
+    lib.cinearc_generations.argtypes = [arc_p]
+    lib.cinearc_generations.restype = i64
+    lib.cinearc_blob_info.argtypes = [arc_p, i64, ctypes.POINTER(Blob)]
+    lib.cinearc_read.argtypes = [arc_p, i64, ctypes.c_void_p, ctypes.c_size_t]
+    lib.cinearc_read_range.argtypes = [arc_p, i64, i64, i64, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int]
+    lib.cinearc_read_range_f64.argtypes = [arc_p, i64, i64, i64, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int]
+    lib.cinearc_read_column_f64.argtypes = [arc_p, i64, ctypes.c_uint32, ctypes.c_void_p, ctypes.c_size_t]
+    return lib
+
+
+_lib = _load()
+
+
+def _check(res):
+    if res != 0:
+        raise RuntimeError("cinearc: " + _lib.cinearc_last_error().decode())
+
+
+class Archive:
+    def __init__(self, file):
+        self._arc = ctypes.c_void_p()
+        _check(_lib.cinearc_open(os.fsencode(file), ctypes.byref(self._arc)))
+
+    def close(self):
+        if self._arc:
+            _lib.cinearc_close(self._arc)
+            self._arc = ctypes.c_void_p()
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __len__(self):
+        n = _lib.cinearc_generations(self._arc)
+        _check(min(n, 0))
+        return n
+
+    def header(self):
+        return _lib.cinearc_header(self._arc).decode()
+
+    def blob(self, g):
+        info = Blob()
+        _check(_lib.cinearc_blob_info(self._arc, g, ctypes.byref(info)))
+        return info
+
+    def read(self, g, typecode="f"):
+        """blob g as array of typecode ('f': float32, 'i': int32, 'B': raw)"""
+        info = self.blob(g)
+        res = array.array(typecode, bytes(info.n * info.size))
+        addr, n = res.buffer_info()
+        _check(_lib.cinearc_read(self._arc, g, addr, n * res.itemsize))
+        return res
+
+    def read_range(self, g0, g1, stride=1, threads=0):
+        """float32 blobs g0, g0 + stride, ... < g1 as array('d')"""
+        count = len(range(g0, g1, stride))
+        if count == 0:
+            return array.array("d")
+        info = self.blob(g0)
+        res = array.array("d", bytes(8 * count * (info.n * info.size // 4)))
+        addr, n = res.buffer_info()
+        _check(_lib.cinearc_read_range_f64(self._arc, g0, g1, stride, addr, n, threads))
+        return res
+
+    def read_column(self, g, col):
+        """float32 element col of every record of blob g as array('d')"""
+        info = self.blob(g)
+        res = array.array("d", bytes(8 * info.n))
+        addr, n = res.buffer_info()
+        _check(_lib.cinearc_read_column_f64(self._arc, g, col, addr, n))
+        return res
@@ -0,0 +1,69 @@
+/* cinearc_R.c -- R binding of cinearc, for .Call
+
+  Build against the cinearc library, e.g.
+    R CMD SHLIB cinearc_R.c -L<build>/lib -lcinearc
+  and load with
+    dyn.load("cinearc_R.so")
+    G <- .Call("cinearc_R_generations", "agents_fit.arc")
+    fit <- matrix(.Call("cinearc_R_read", "agents_fit.arc", 0L, G, 1L, "double"), nrow=G, byrow=T)
+    anc <- .Call("cinearc_R_read", "agents_anc.arc", 10L, 11L, 1L, "integer")
+*/
+
+#include <string.h>
+#include <R.h>
+#include <Rinternals.h>
+#include "cinearc.h"
+
+
+static cinearc* open_or_error(SEXP file)
+{
+  cinearc* arc = NULL;
+  if (!isString(file) || LENGTH(file) != 1) error("file shall be a string");
+  if (cinearc_open(CHAR(STRING_ELT(file, 0)), &arc) != CINEARC_OK) {
+    error("cinearc: %s", cinearc_last_error());
+  }
+  return arc;
+}
+
+
+SEXP cinearc_R_generations(SEXP file)
+{
+  cinearc* arc = open_or_error(file);
+  const int64_t n = cinearc_generations(arc);
+  cinearc_close(arc);
+  return ScalarInteger((int)n);
+}
+
+
+/* generations g0, g0 + stride, ... < g1 back to back;
+   type "double": float32 blobs widened, "integer": int32 blobs */
+SEXP cinearc_R_read(SEXP file, SEXP g0, SEXP g1, SEXP stride, SEXP type)
+{
+  const int a = asInteger(g0), b = asInteger(g1), s = asInteger(stride);
+  const int as_int = isString(type) && strcmp(CHAR(STRING_ELT(type, 0)), "integer") == 0;
+  cinearc* arc = open_or_error(file);
+  cinearc_blob info;
+  R_xlen_t count = 0;
+  int res = CINEARC_OK;
+  SEXP ans;
+  if (s <= 0) {
+    cinearc_close(arc);
+    error("stride shall be > 0");
+  }
+  if (a < b) {
+    res = cinearc_blob_info(arc, a, &info);
+    count = (R_xlen_t)((b - a + s - 1) / s) * (R_xlen_t)(((size_t)info.n * info.size) / 4);
+  }
+  if (res == CINEARC_OK) {
+    ans = PROTECT(allocVector(as_int ? INTSXP : REALSXP, count));
+    if (count) {
+      res = as_int
+        ? cinearc_read_range(arc, a, b, s, INTEGER(ans), (size_t)count * sizeof(int), 0)
+        : cinearc_read_range_f64(arc, a, b, s, REAL(ans), (size_t)count, 0);
+    }
+  }
+  cinearc_close(arc);
+  if (res != CINEARC_OK) error("cinearc: %s", cinearc_last_error());
+  UNPROTECT(1);
+  return ans;
+}
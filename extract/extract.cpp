@@ -1,4 +1,6 @@
 #include <iostream>
+#include <sstream>
+#include <type_traits>
 #include <cine/cmd_line.h>
 #include <cine/archive.hpp>
 
@@ -6,23 +8,93 @@
 using namespace archive;
 
 
+// upper bound of the uncompressed blobs held at once
+const size_t max_chunk_bytes = size_t(256) << 20;
+
+
+std::vector<std::string> split(const std::string& str, char delim)
+{
+  std::vector<std::string> res;
+  std::istringstream is(str);
+  std::string item;
+  while (std::getline(is, item, delim)) {
+    if (!item.empty()) res.push_back(item);
+  }
+  return res;
+}
+
+
+// comma separated list of generations and ranges:
+// "g", "g0:g1" = g0, ..., g1 - 1 and "g0:g1:stride"
+std::vector<size_t> parse_generations(const std::string& str)
+{
+  std::vector<size_t> res;
+  for (const auto& item : split(str, ',')) {
+    const auto r = split(item, ':');
+    try {
+      if (r.size() == 1) {
+        res.push_back(std::stoul(r[0]));
+      }
+      else if (r.size() == 2 || r.size() == 3) {
+        const size_t g0 = std::stoul(r[0]);
+        const size_t g1 = std::stoul(r[1]);
+        const size_t stride = (r.size() == 3) ? std::stoul(r[2]) : 1;
+        if (stride == 0) throw cmd::parse_error("G: stride shall be > 0");
+        for (size_t g = g0; g < g1; g += stride) res.push_back(g);
+      }
+      else {
+        throw cmd::parse_error("G: invalid range '" + item + "'");
+      }
+    }
+    catch (std::logic_error&) {
+      throw cmd::parse_error("G: invalid generation '" + item + "'");
+    }
+  }
+  if (res.empty()) throw cmd::parse_error("G: no generation");
+  return res;
+}
+
+
+// writes the generations G of arc as U[] to out, consecutively
 template <typename T, typename U>
-void convert(const fs::path& tmp, const fs::path& arc, int G)
+void convert(const fs::path& out, const fs::path& arc, const std::vector<size_t>& G, int threads)
 {
-  iarch ia(arc);
-  auto cm = ia.extract(G);
-  auto dst = compressed_mem::buffer((unsigned char*)std::malloc(cm.un * cm.usize), std::free);
-  uncompress(dst.get(), cm);
-  size_t n = (cm.un * cm.usize) / sizeof(T);
-  std::vector<U> res(n);
-  const T* p = (const T*)dst.get();
-  for (size_t i = 0; i < n; ++i) {
-    res[i] = static_cast<U>(p[i]);
+  mapped_iarch ia(arc);
+  size_t bytes = 0;
+  for (auto g : G) {
+    if (g >= ia.size()) throw std::runtime_error(arc.string() + ": generation " + std::to_string(g) + " not archived");
+    const auto& e = ia.entry(g);
+    const size_t b = size_t(e.un) * e.usize;
+    if (b % sizeof(T)) throw std::runtime_error(arc.string() + ": invalid blob size");
+    if (bytes && b != bytes) throw std::runtime_error(arc.string() + ": blob size varies between generations");
+    bytes = b;
   }
   std::filebuf fb;
-  fb.open(tmp, std::ios::out | std::ios::binary); 
+  fb.open(out, std::ios::out | std::ios::binary);
   if (!fb.is_open()) throw std::runtime_error("can't create output file");
-  fb.sputn((char*)res.data(), n * sizeof(U));
+  const size_t chunk = std::max<size_t>(1, max_chunk_bytes / std::max<size_t>(1, bytes));
+  const size_t n = bytes / sizeof(T);
+  std::vector<std::vector<T>> buf(std::min(chunk, G.size()), std::vector<T>(n));
+  std::vector<U> res(std::is_same<T, U>::value ? 0 : n);
+  for (size_t c0 = 0; c0 < G.size(); c0 += chunk) {
+    const size_t c1 = std::min(G.size(), c0 + chunk);
+    const std::vector<size_t> idx(G.begin() + c0, G.begin() + c1);
+    std::vector<void*> dst;
+    for (size_t i = 0; i < idx.size(); ++i) dst.push_back(buf[i].data());
+    ia.extract_list(idx, dst.data(), threads);
+    for (size_t i = 0; i < idx.size(); ++i) {
+      if (std::is_same<T, U>::value) {
+        fb.sputn((const char*)buf[i].data(), n * sizeof(T));
+      }
+      else {
+        const T* p = buf[i].data();
+        for (size_t j = 0; j < n; ++j) {
+          res[j] = static_cast<U>(p[j]);
+        }
+        fb.sputn((const char*)res.data(), n * sizeof(U));
+      }
+    }
+  }
 }
 
 
@@ -35,15 +107,31 @@ int main(int argc, const char** argv)
       fs::remove_all(dir / "tmp");
       return 0;
     }
-    auto G = clp.required<int>("G");
+    const auto G = parse_generations(clp.required<std::string>("G"));
     auto what = clp.required<std::string>("what");
-    auto tmp = dir / "tmp";
-    fs::create_directory(tmp);
-    convert<float, double>(tmp / (what + "_fit.tmp"), dir / (what + "_fit.arc"), G);
-    convert<float, double>(tmp / (what + "_foa.tmp"), dir / (what + "_foa.arc"), G);
-    convert<float, double>(tmp / (what + "_han.tmp"), dir / (what + "_han.arc"), G);
-    convert<int, int>(tmp / (what + "_anc.tmp"), dir / (what + "_anc.arc"), G);
-    convert<float, double>(tmp / (what + "_ann.tmp"), dir / (what + "_ann.arc"), G);
+    const auto streams = split(clp.optional_val("streams", std::string("fit,foa,han,anc,ann")), ',');
+    const bool float32 = clp.flag("--float32");
+    const int threads = clp.optional_val("threads", 0);
+    auto out = clp.optional_val("out", dir / "tmp");
+    for (const auto& s : streams) {
+      if (!(s == "ann" || s == "fit" || s == "anc" || s == "foa" || s == "han")) {
+        throw cmd::parse_error("streams shall be a list of ann, fit, anc, foa and han");
+      }
+    }
+    fs::create_directories(out);
+    for (const auto& s : streams) {
+      const auto tmp = out / (what + "_" + s + ".tmp");
+      const auto arc = dir / (what + "_" + s + ".arc");
+      if (s == "anc") {
+        convert<int, int>(tmp, arc, G, threads);
+      }
+      else if (float32) {
+        convert<float, float>(tmp, arc, G, threads);
+      }
+      else {
+        convert<float, double>(tmp, arc, G, threads);
+      }
+    }
     return 0;
   }
   catch (cmd::parse_error& err) {
@@ -57,4 +145,3 @@ int main(int argc, const char** argv)
   }
   return 1;
 }
-
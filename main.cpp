@@ -4,7 +4,9 @@
 #include "cine/simulation.h"
 #include "cine/cmd_line.h"
 #include "cine/cnObserver.h"
+#if !defined(CINE2_HEADLESS)
 #include "cinema/AppWin.h"
+#endif
 #include <cine/archive.hpp>
 
 
@@ -12,7 +14,7 @@ using namespace cine2;
 
 
 static_assert(std::is_trivially_copyable<Individual>::value, 
-              "Folks, you've messed up the Individual class");
+              "Folks, you've messed up the Individual view");
 
 
 int main(int argc, const char** argv)
@@ -33,14 +35,21 @@ int main(int argc, const char** argv)
     }
     // create simulation host
     std::unique_ptr<SimulationHost> host;
+#if defined(CINE2_HEADLESS)
+    if (gui) throw std::runtime_error("--gui requested but this build is headless");
+    host.reset(new SimulationHost());
+#else
     host.reset(gui ? new cinema::AppWin() 
                    : new SimulationHost()
     );
+#endif
 
     // create observer chain
     auto headObserver = std::unique_ptr<Observer>(new Observer());    // dummy observer for chaining
     std::unique_ptr<Observer> cmdline_observer = quiet ? nullptr : CreateSimpleObserver();
-    std::unique_ptr<Observer> cn_observer = param.outdir.empty() ? nullptr : CreateCnObserver(param.outdir);
+    std::unique_ptr<Observer> cn_observer = param.outdir.empty() ? nullptr 
+                                          : param.replay.file.empty() ? CreateCnObserver(param.outdir) 
+                                          : CreateTraceObserver(param.outdir);
     headObserver->chain_back(cmdline_observer.get());
     headObserver->chain_back(cn_observer.get());
     if (!host->run(headObserver.get(), param)) {